@@ -0,0 +1,265 @@
+#!/usr/bin/env python3
+# Compare results from the test application across processors/runs
+#
+# Reads the plain text output (as found in results/*.txt), as well as the
+# output of `test --format=json` and `test --format=csv`.  The file name
+# (minus extension) is used as the name of the processor/system.
+#
+#   python3 compare.py table [results/]          # best strategy per CPU
+#   python3 compare.py penalty [results/]        # SMC penalty of every strategy, per CPU
+#   python3 compare.py chart [results/] [-o results/chart.png]
+#   python3 compare.py diff old.json new.json [--threshold 5]
+
+import argparse
+import csv
+import json
+import math
+import os
+import re
+import sys
+
+BASELINE = 'jit_plain'  # the obvious approach
+IDEAL = 'jit_only'      # write without executing, i.e. no SMC penalty
+
+# strategies which don't synchronise before executing the code, so can execute stale code
+# (as `test --verify` shows); keep in sync with STRATEGY_UNSYNCED in test.c
+UNSYNCED = {
+	'jit_memcpy_sse2_nt', 'jit_memcpy_avx_nt', 'jit_memcpy_avx3_nt',  # non-temporal copy without SFENCE
+	'jit_fused_nt',
+	'jit_dual_mapping_nosync',  # no CPUID after writing
+}
+# strategies which don't actually solve the problem, so shouldn't be recommended
+NOT_SOLUTIONS = {IDEAL} | UNSYNCED
+
+# anything after this (e.g. energy, with --energy) is ignored
+TEXT_LINE = re.compile(r'^\s*(\S+)\s+(\d+)\s+rdtsc counts(\s|$)')
+
+
+DEFAULT_MODE = 'strategies'
+
+# the value compared for each mode (lower is better); modes not listed here report `min` rdtsc counts
+MODE_METRIC = {
+	'tiering': 'crossover',
+	'verify': 'stale',
+	'prep': 'p99',
+	'lifecycle': 'total',
+}
+# columns naming each row, for modes whose rows have no `name` or `strategy`
+MODE_KEYS = {
+	'prep': ('prep', 'where', 'idle_pct'),
+	'lifecycle': ('variant', 'threads'),
+}
+
+
+def row_name(mode, r):
+	if mode in MODE_KEYS:
+		return '/'.join(str(r[k]) for k in MODE_KEYS[mode])
+	# modes which report several rows per strategy give each a distinct name
+	return r.get('name') or r['strategy']
+
+
+def row_value(mode, value):
+	value = float(value)
+	if mode == 'tiering' and value == 0:
+		return float('inf')  # JIT never wins
+	return value
+
+
+def load_file(path):
+	"""Returns (mode, dict of strategy -> value of the mode's metric, e.g. min rdtsc count)"""
+	ext = os.path.splitext(path)[1].lower()
+	mode = DEFAULT_MODE
+	rows = []
+	if ext == '.json':
+		with open(path) as f:
+			data = json.load(f)
+		mode = data.get('mode', DEFAULT_MODE)
+		rows = data['results']
+	elif ext == '.csv':
+		with open(path, newline='') as f:
+			rows = list(csv.DictReader(f))
+		if rows:
+			mode = rows[0].get('mode') or DEFAULT_MODE
+	else:
+		with open(path) as f:
+			for line in f:
+				m = TEXT_LINE.match(line)
+				if m:
+					rows.append({'strategy': m.group(1), 'min': m.group(2)})
+	metric = MODE_METRIC.get(mode, 'min')
+	values = {}
+	for r in rows:
+		if r.get(metric) not in (None, ''):
+			values[row_name(mode, r)] = row_value(mode, r[metric])
+	return mode, values
+
+
+def load_dir(path):
+	"""Returns a dict of system name -> {strategy -> min rdtsc count}, for results of the normal test"""
+	if os.path.isfile(path):
+		mode, times = load_file(path)
+		if mode != DEFAULT_MODE:
+			print('%s: results are from --%s, not the normal test' % (path, mode), file=sys.stderr)
+			return {}
+		return {os.path.splitext(os.path.basename(path))[0]: times}
+	systems = {}
+	for name in sorted(os.listdir(path)):
+		base, ext = os.path.splitext(name)
+		if ext.lower() not in ('.txt', '.json', '.csv'):
+			continue
+		mode, times = load_file(os.path.join(path, name))
+		if times and mode == DEFAULT_MODE:
+			systems[base] = times
+	return systems
+
+
+def penalties(times):
+	"""SMC penalty (time above `jit_only`) of each strategy, and relative to `jit_plain`"""
+	if IDEAL not in times or BASELINE not in times:
+		return None
+	ideal = times[IDEAL]
+	base_penalty = times[BASELINE] - ideal
+	result = {}
+	for strat, t in times.items():
+		pen = t - ideal
+		result[strat] = (pen, pen / base_penalty if base_penalty > 0 else float('nan'))
+	return result
+
+
+def best_strategy(times):
+	candidates = {s: t for s, t in times.items() if s not in NOT_SOLUTIONS}
+	strat = min(candidates, key=candidates.get)
+	return strat, candidates[strat]
+
+
+def cmd_table(args):
+	systems = load_dir(args.path)
+	print('| System | `%s` penalty | Best strategy | Best penalty | Relative |' % BASELINE)
+	print('|---|--:|---|--:|--:|')
+	for name, times in systems.items():
+		pens = penalties(times)
+		if pens is None:
+			print('| %s | ? | ? | ? | ? |' % name, file=sys.stderr)
+			continue
+		strat, _ = best_strategy(times)
+		print('| %s | %d | `%s` | %d | %.0f%% |' % (
+			name, pens[BASELINE][0], strat, pens[strat][0], pens[strat][1] * 100))
+
+
+def cmd_penalty(args):
+	systems = load_dir(args.path)
+	names = list(systems.keys())
+	strategies = []
+	for times in systems.values():
+		for s in times:
+			if s not in strategies:
+				strategies.append(s)
+	pens = {n: penalties(systems[n]) or {} for n in names}
+	w = csv.writer(sys.stdout)
+	w.writerow(['strategy'] + names)
+	for s in strategies:
+		row = [s]
+		for n in names:
+			if s in pens[n]:
+				row.append('%.3f' % pens[n][s][1])
+			else:
+				row.append('')
+		w.writerow(row)
+
+
+def cmd_chart(args):
+	try:
+		import matplotlib
+		matplotlib.use('Agg')
+		import matplotlib.pyplot as plt
+	except ImportError:
+		print('matplotlib is required to draw the chart', file=sys.stderr)
+		return 1
+	systems = load_dir(args.path)
+	labels, plain, best = [], [], []
+	for name, times in systems.items():
+		pens = penalties(times)
+		if pens is None:
+			continue
+		strat, _ = best_strategy(times)
+		labels.append(name)
+		plain.append(max(pens[BASELINE][0], 0) / 1000.0)
+		best.append(max(pens[strat][0], 0) / 1000.0)
+
+	fig, ax = plt.subplots(figsize=(10, 0.4 * len(labels) + 1.5))
+	y = range(len(labels))
+	ax.barh([i + 0.2 for i in y], plain, height=0.4, label='Plain (%s)' % BASELINE)
+	ax.barh([i - 0.2 for i in y], best, height=0.4, label='Best technique')
+	ax.set_yticks(list(y))
+	ax.set_yticklabels(labels)
+	ax.invert_yaxis()
+	ax.set_xlabel('SMC penalty (thousand rdtsc counts per 1000 JIT calls)')
+	ax.legend()
+	fig.tight_layout()
+	fig.savefig(args.output)
+	print('Wrote ' + args.output)
+	return 0
+
+
+def percent_change(old, new):
+	if old == new:
+		return 0.0
+	if old == 0 or math.isinf(old):
+		return math.copysign(float('inf'), new - old)
+	return (new - old) * 100.0 / old
+
+
+def cmd_diff(args):
+	old_mode, old = load_file(args.old)
+	new_mode, new = load_file(args.new)
+	if old_mode != new_mode:
+		print('Cannot compare results from different modes (%s vs %s)' % (old_mode, new_mode), file=sys.stderr)
+		return 2
+	common = [s for s in old if s in new]
+	if not common:
+		print('No results in common between %s and %s' % (args.old, args.new), file=sys.stderr)
+		return 2
+	regressions = 0
+	print('%-30s  %10s  %10s  %7s  (%s)' % ('strategy', 'old', 'new', 'change', MODE_METRIC.get(old_mode, 'min')))
+	for s in common:
+		change = percent_change(old[s], new[s])
+		flag = ''
+		if change > args.threshold:
+			flag = '  REGRESSION'
+			regressions += 1
+		elif change < -args.threshold:
+			flag = '  improved'
+		print('%-30s  %10.0f  %10.0f  %+6.1f%%%s' % (s, old[s], new[s], change, flag))
+	return 1 if regressions else 0
+
+
+def main():
+	parser = argparse.ArgumentParser(description='Compare JIT SMC test results')
+	sub = parser.add_subparsers(dest='cmd')
+	sub.required = True
+
+	p = sub.add_parser('table', help='best strategy per system, as a Markdown table')
+	p.add_argument('path', nargs='?', default='results')
+	p.set_defaults(fn=cmd_table)
+
+	p = sub.add_parser('penalty', help='SMC penalty of each strategy relative to %s (CSV)' % BASELINE)
+	p.add_argument('path', nargs='?', default='results')
+	p.set_defaults(fn=cmd_penalty)
+
+	p = sub.add_parser('chart', help='regenerate the penalty chart')
+	p.add_argument('path', nargs='?', default='results')
+	p.add_argument('-o', '--output', default=os.path.join('results', 'chart.png'))
+	p.set_defaults(fn=cmd_chart)
+
+	p = sub.add_parser('diff', help='flag regressions between two runs')
+	p.add_argument('old')
+	p.add_argument('new')
+	p.add_argument('--threshold', type=float, default=5.0, help='percentage change to flag (default 5)')
+	p.set_defaults(fn=cmd_diff)
+
+	args = parser.parse_args()
+	sys.exit(args.fn(args) or 0)
+
+
+if __name__ == '__main__':
+	main()
@@ -1,3 +1,6 @@
+#ifdef __linux__
+# define _GNU_SOURCE // for SCHED_IDLE, mremap, memfd_create, CPU affinity
+#endif
 #include <stdint.h>
 #include <inttypes.h>
 #include <stdio.h>
@@ -7,6 +10,8 @@
 
 // compile with `cc -g -std=gnu99 -O3 -march=native -o test test.c jump.s`
 // or on systems which need librt: `cc -g -std=gnu99 -O3 -march=native -o test test.c jump.s -lrt`
+// on Linux, add `-pthread` if your libc needs it
+// add `-DVERIFY` to build with --verify; this changes the code generated for each strategy, so don't use it for timing
 
 // static compile: `cc -s -static -std=gnu99 -O3 -march=<arch> -o test test.c jump.s`
 // or linux: `cc -s -static -std=gnu99 -O3 -march=<arch> -o test test.c jump.s -lrt -pthread -Wl,--whole-archive -lpthread -Wl,--no-whole-archive`
@@ -21,6 +26,7 @@ const int ITERS = 1000;
 const int TRIALS = 10;
 #define TEST_TRIALS 1
 const int CODE_SIZE = 1024;
+#define MAX_CODE_SIZE 65536 // largest size used by the sweeps
 
 // aliased memory code adapted from https://nullprogram.com/blog/2016/04/10/
 #if defined(_WINDOWS) || defined(__WINDOWS__) || defined(_WIN32) || defined(_WIN64)
@@ -125,6 +131,265 @@ static __inline__ uint64_t rdtsc() {
 #endif
 }
 
+#ifdef _MSC_VER
+# include <intrin.h>
+# define _cpuid __cpuid
+#else
+# include <cpuid.h>
+# define _cpuid(ar, eax) __cpuid(eax, ar[0], ar[1], ar[2], ar[3])
+#endif
+
+// identify the CPU, so that results from different machines can be told apart
+typedef struct {
+	char vendor[13];
+	char brand[49];
+	uint32_t signature; // CPUID.1:EAX
+	unsigned family, model, stepping;
+} cpu_sig_t;
+static void get_cpu_sig(cpu_sig_t* sig) {
+	int id[4];
+	memset(sig, 0, sizeof(*sig));
+	_cpuid(id, 0);
+	memcpy(sig->vendor, id+1, 4);
+	memcpy(sig->vendor+4, id+3, 4);
+	memcpy(sig->vendor+8, id+2, 4);
+	
+	_cpuid(id, 1);
+	sig->signature = id[0];
+	sig->family = (id[0] >> 8) & 0xf;
+	sig->model = (id[0] >> 4) & 0xf;
+	sig->stepping = id[0] & 0xf;
+	if(sig->family == 6 || sig->family == 0xf)
+		sig->model |= ((id[0] >> 16) & 0xf) << 4;
+	if(sig->family == 0xf)
+		sig->family += (id[0] >> 20) & 0xff;
+	
+	_cpuid(id, 0x80000000);
+	if((unsigned)id[0] >= 0x80000004) {
+		for(int i=0; i<3; i++) {
+			_cpuid(id, 0x80000002+i);
+			memcpy(sig->brand + i*16, id, 16);
+		}
+		// strip leading spaces that some CPUs pad the brand string with
+		char* p = sig->brand;
+		while(*p == ' ') p++;
+		memmove(sig->brand, p, strlen(p)+1);
+	}
+}
+
+
+// performance counters, sampled around the timed loop (Linux only)
+#define NUM_COUNTERS 4
+static const char* counter_names[NUM_COUNTERS] = {
+	"cycles", "instructions", "l1i_misses", "smc_clears"
+};
+static uint64_t counter_values[NUM_COUNTERS];
+static int counters_active = 0;
+#ifdef __linux__
+# include <linux/perf_event.h>
+# include <sys/syscall.h>
+# include <sys/ioctl.h>
+static int counter_fds[NUM_COUNTERS] = {-1, -1, -1, -1};
+static int counter_open(uint32_t type, uint64_t config) {
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+// returns the number of counters that could be opened
+static int counters_init(const cpu_sig_t* cpu) {
+	int opened = 0;
+	counter_fds[0] = counter_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+	counter_fds[1] = counter_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+	counter_fds[2] = counter_open(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1I
+		| (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+	// MACHINE_CLEARS.SMC (event C3h, umask 04h) exists on Intel Core since Nehalem
+	if(!strcmp(cpu->vendor, "GenuineIntel") && cpu->family == 6)
+		counter_fds[3] = counter_open(PERF_TYPE_RAW, 0x04c3);
+	for(int i=0; i<NUM_COUNTERS; i++)
+		if(counter_fds[i] >= 0) opened++;
+	counters_active = opened > 0;
+	return opened;
+}
+static void counters_start() {
+	for(int i=0; i<NUM_COUNTERS; i++) {
+		if(counter_fds[i] < 0) continue;
+		ioctl(counter_fds[i], PERF_EVENT_IOC_RESET, 0);
+		ioctl(counter_fds[i], PERF_EVENT_IOC_ENABLE, 0);
+	}
+}
+static void counters_stop() {
+	for(int i=0; i<NUM_COUNTERS; i++) {
+		if(counter_fds[i] < 0) continue;
+		ioctl(counter_fds[i], PERF_EVENT_IOC_DISABLE, 0);
+		if(read(counter_fds[i], &counter_values[i], sizeof(uint64_t)) != sizeof(uint64_t))
+			counter_values[i] = ~0ULL;
+	}
+}
+static int counter_available(int i) {
+	return counter_fds[i] >= 0;
+}
+#else
+static int counters_init(const cpu_sig_t* cpu) {
+	(void)cpu;
+	return 0;
+}
+static void counters_start() {}
+static void counters_stop() {}
+static int counter_available(int i) {
+	(void)i;
+	return 0;
+}
+#endif
+
+
+// energy usage via RAPL, either through the powercap interface or MSRs (Linux only)
+#define NUM_RAPL_DOMAINS 2
+static const char* rapl_domain_names[NUM_RAPL_DOMAINS] = {"package", "core"};
+enum { RAPL_NONE, RAPL_POWERCAP, RAPL_MSR };
+static int rapl_source = RAPL_NONE;
+#ifdef __linux__
+# include <time.h>
+# include <sched.h>
+# define MAX_RAPL_PACKAGES 8
+// powercap: one path per package and domain
+static char rapl_paths[NUM_RAPL_DOMAINS][MAX_RAPL_PACKAGES][128];
+static uint64_t rapl_range[NUM_RAPL_DOMAINS][MAX_RAPL_PACKAGES]; // counters wrap at this value
+static int rapl_packages = 0;
+// MSR: only covers the package (and on AMD, the core) of one CPU, so the test gets pinned to it whilst measuring
+static int rapl_msr_fd = -1;
+static int rapl_msr_cpu = 0;
+static uint32_t rapl_msr_addr[NUM_RAPL_DOMAINS];
+static int rapl_msr_present[NUM_RAPL_DOMAINS]; // not all CPUs have every domain, e.g. Xeons lack the core counter
+static double rapl_msr_unit; // joules per count
+
+static int read_u64_file(const char* path, uint64_t* value) {
+	FILE* f = fopen(path, "r");
+	if(!f) return 0;
+	int ok = fscanf(f, "%" SCNu64, value) == 1;
+	fclose(f);
+	return ok;
+}
+
+static int rapl_init(const cpu_sig_t* cpu) {
+	char path[128], name[32];
+	uint64_t value;
+	// powercap: packages are intel-rapl:N, with subdomains intel-rapl:N:M (which are named)
+	for(rapl_packages=0; rapl_packages<MAX_RAPL_PACKAGES; rapl_packages++) {
+		int pkg = rapl_packages;
+		snprintf(rapl_paths[0][pkg], sizeof(rapl_paths[0][pkg]), "/sys/class/powercap/intel-rapl:%d/energy_uj", pkg);
+		if(!read_u64_file(rapl_paths[0][pkg], &value)) break;
+		snprintf(path, sizeof(path), "/sys/class/powercap/intel-rapl:%d/max_energy_range_uj", pkg);
+		if(!read_u64_file(path, &rapl_range[0][pkg])) rapl_range[0][pkg] = 0;
+		
+		rapl_paths[1][pkg][0] = 0;
+		for(int sub=0; sub<8; sub++) {
+			snprintf(path, sizeof(path), "/sys/class/powercap/intel-rapl:%d:%d/name", pkg, sub);
+			FILE* f = fopen(path, "r");
+			if(!f) break;
+			int found = fscanf(f, "%31s", name) == 1 && !strcmp(name, "core");
+			fclose(f);
+			if(found) {
+				snprintf(rapl_paths[1][pkg], sizeof(rapl_paths[1][pkg]), "/sys/class/powercap/intel-rapl:%d:%d/energy_uj", pkg, sub);
+				snprintf(path, sizeof(path), "/sys/class/powercap/intel-rapl:%d:%d/max_energy_range_uj", pkg, sub);
+				if(!read_u64_file(path, &rapl_range[1][pkg])) rapl_range[1][pkg] = 0;
+				break;
+			}
+		}
+	}
+	if(rapl_packages) {
+		rapl_source = RAPL_POWERCAP;
+		return 1;
+	}
+	
+	// fall back to reading MSRs (needs the msr module and root)
+	uint32_t unit_msr;
+	if(!strcmp(cpu->vendor, "GenuineIntel")) {
+		unit_msr = 0x606;
+		rapl_msr_addr[0] = 0x611; // MSR_PKG_ENERGY_STATUS
+		rapl_msr_addr[1] = 0x639; // MSR_PP0_ENERGY_STATUS
+	} else if(!strcmp(cpu->vendor, "AuthenticAMD") || !strcmp(cpu->vendor, "HygonGenuine")) {
+		unit_msr = 0xc0010299;
+		rapl_msr_addr[0] = 0xc001029b;
+		rapl_msr_addr[1] = 0xc001029a;
+	} else
+		return 0;
+	rapl_msr_cpu = sched_getcpu();
+	if(rapl_msr_cpu < 0) rapl_msr_cpu = 0;
+	snprintf(path, sizeof(path), "/dev/cpu/%d/msr", rapl_msr_cpu);
+	rapl_msr_fd = open(path, O_RDONLY);
+	if(rapl_msr_fd < 0) return 0;
+	if(pread(rapl_msr_fd, &value, 8, unit_msr) != 8) {
+		close(rapl_msr_fd);
+		rapl_msr_fd = -1;
+		return 0;
+	}
+	rapl_msr_unit = 1.0 / (1 << ((value >> 8) & 0x1f));
+	for(int d=0; d<NUM_RAPL_DOMAINS; d++)
+		rapl_msr_present[d] = pread(rapl_msr_fd, &value, 8, rapl_msr_addr[d]) == 8;
+	if(!rapl_msr_present[0]) {
+		close(rapl_msr_fd);
+		rapl_msr_fd = -1;
+		return 0;
+	}
+	rapl_source = RAPL_MSR;
+	return 1;
+}
+
+// raw counter values; use rapl_joules() to get the difference between two readings
+typedef struct {
+	uint64_t raw[NUM_RAPL_DOMAINS][MAX_RAPL_PACKAGES];
+	struct timespec time;
+} rapl_sample_t;
+static void rapl_read(rapl_sample_t* sample) {
+	memset(sample->raw, 0, sizeof(sample->raw));
+	if(rapl_source == RAPL_POWERCAP) {
+		for(int d=0; d<NUM_RAPL_DOMAINS; d++)
+			for(int pkg=0; pkg<rapl_packages; pkg++)
+				if(rapl_paths[d][pkg][0])
+					read_u64_file(rapl_paths[d][pkg], &sample->raw[d][pkg]);
+	} else if(rapl_source == RAPL_MSR) {
+		for(int d=0; d<NUM_RAPL_DOMAINS; d++)
+			if(rapl_msr_present[d] && pread(rapl_msr_fd, &sample->raw[d][0], 8, rapl_msr_addr[d]) == 8)
+				sample->raw[d][0] &= 0xffffffff;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &sample->time);
+}
+// returns -1 if the domain isn't available
+static double rapl_joules(const rapl_sample_t* start, const rapl_sample_t* end, int domain) {
+	double joules = 0;
+	if(rapl_source == RAPL_POWERCAP) {
+		if(!rapl_paths[domain][0][0]) return -1;
+		for(int pkg=0; pkg<rapl_packages; pkg++) {
+			uint64_t diff = end->raw[domain][pkg] - start->raw[domain][pkg];
+			if(end->raw[domain][pkg] < start->raw[domain][pkg])
+				diff += rapl_range[domain][pkg];
+			joules += diff / 1e6;
+		}
+	} else if(rapl_source == RAPL_MSR) {
+		if(!rapl_msr_present[domain]) return -1;
+		uint64_t diff = (end->raw[domain][0] - start->raw[domain][0]) & 0xffffffff;
+		joules = diff * rapl_msr_unit;
+	} else
+		return -1;
+	return joules;
+}
+static double elapsed_seconds(const rapl_sample_t* start, const rapl_sample_t* end) {
+	return (end->time.tv_sec - start->time.tv_sec) + (end->time.tv_nsec - start->time.tv_nsec) / 1e9;
+}
+#else
+static int rapl_init(const cpu_sig_t* cpu) {
+	(void)cpu;
+	return 0;
+}
+#endif
+
+
 static uint64_t time_jit(stratfunc_t fn, void* dst) {
 	// to try to reduce variability, run multiple trials, and find lowest value
 	uint64_t result = ~0ULL;
@@ -134,16 +399,303 @@ static uint64_t time_jit(stratfunc_t fn, void* dst) {
 		// warmup (try to exclude variability present in initial rounds)
 		for(int i=0; i<PRE_ITERS; i++)
 			fn(dst);
+		if(counters_active) counters_start();
 		starttime = rdtsc();
 		for(int i=0; i<ITERS; i++)
 			fn(dst);
 		stoptime = rdtsc();
+		if(counters_active) counters_stop();
 		stoptime -= starttime;
 		if(stoptime < result) result = stoptime;
 	}
 	return result;
 }
 
+// RAPL counters only update around every millisecond, so keep running the test until enough time has passed to get a reasonable reading
+#define ENERGY_MIN_SECONDS 0.2
+typedef struct {
+	int available;
+	double uj_per_kb[NUM_RAPL_DOMAINS]; // -1 if domain not available
+	double edp; // package energy * time, per JIT call (J*s)
+} energy_result_t;
+static void measure_energy(stratfunc_t fn, void* dst, energy_result_t* result) {
+	result->available = 0;
+#ifdef __linux__
+	if(rapl_source == RAPL_NONE) return;
+	cpu_set_t saved;
+	if(rapl_source == RAPL_MSR) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(rapl_msr_cpu, &set);
+		if(sched_getaffinity(0, sizeof(saved), &saved) || sched_setaffinity(0, sizeof(set), &set))
+			return;
+	}
+	rapl_sample_t start, end;
+	uint64_t calls = 0;
+	rapl_read(&start);
+	do {
+		time_jit(fn, dst);
+		calls += (uint64_t)TEST_TRIALS * (PRE_ITERS + ITERS);
+		rapl_read(&end);
+	} while(elapsed_seconds(&start, &end) < ENERGY_MIN_SECONDS);
+	
+	double kb = (double)calls * CODE_SIZE / 1024;
+	for(int d=0; d<NUM_RAPL_DOMAINS; d++) {
+		double joules = rapl_joules(&start, &end, d);
+		result->uj_per_kb[d] = joules < 0 ? -1 : joules * 1e6 / kb;
+	}
+	double pkg_joules = rapl_joules(&start, &end, 0);
+	result->edp = (pkg_joules / calls) * (elapsed_seconds(&start, &end) / calls);
+	result->available = 1;
+	if(rapl_source == RAPL_MSR)
+		sched_setaffinity(0, sizeof(saved), &saved);
+#else
+	(void)fn;
+	(void)dst;
+#endif
+}
+
+
+/**************************************/
+// result reporting
+
+enum { FORMAT_TEXT, FORMAT_JSON, FORMAT_CSV };
+static int output_format = FORMAT_TEXT;
+static int energy_mode = 0;
+static cpu_sig_t cpu_sig;
+
+typedef struct {
+	const char* name;
+	uint64_t min, median, mean, max;
+	uint64_t counters[NUM_COUNTERS]; // from the fastest trial
+	energy_result_t energy;
+} test_result_t;
+
+static int cmp_u64(const void* a, const void* b) {
+	uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+	return (x > y) - (x < y);
+}
+static void summarise_samples(test_result_t* result, const uint64_t* samples, int n) {
+	uint64_t sorted[n];
+	uint64_t sum = 0;
+	memcpy(sorted, samples, n * sizeof(uint64_t));
+	qsort(sorted, n, sizeof(uint64_t), cmp_u64);
+	for(int i=0; i<n; i++)
+		sum += sorted[i];
+	result->min = sorted[0];
+	result->max = sorted[n-1];
+	result->median = (n & 1) ? sorted[n/2] : (sorted[n/2-1] + sorted[n/2]) / 2;
+	result->mean = sum / n;
+}
+
+// CSV/JSON safe string output (brand strings can contain anything)
+static void print_quoted(const char* str) {
+	putchar('"');
+	for(; *str; str++) {
+		if(output_format == FORMAT_CSV && *str == '"')
+			fputs("\"\"", stdout);
+		else if(output_format == FORMAT_JSON && (*str == '"' || *str == '\\'))
+			printf("\\%c", *str);
+		else
+			putchar(*str);
+	}
+	putchar('"');
+}
+
+static int report_count = 0;
+static const char* report_mode = "strategies";
+// `mode` identifies what's being measured, so that results from different modes aren't mixed up
+static void report_begin(const char* mode) {
+	report_count = 0;
+	report_mode = mode;
+	if(output_format == FORMAT_JSON) {
+		printf("{\n  \"cpu\": {\"vendor\": ");
+		print_quoted(cpu_sig.vendor);
+		printf(", \"brand\": ");
+		print_quoted(cpu_sig.brand);
+		printf(", \"signature\": \"%08" PRIx32 "\", \"family\": %u, \"model\": %u, \"stepping\": %u},\n",
+			cpu_sig.signature, cpu_sig.family, cpu_sig.model, cpu_sig.stepping);
+		printf("  \"mode\": \"%s\",\n  \"code_size\": %d,\n  \"iters\": %d,\n  \"trials\": %d,\n  \"results\": [",
+			mode, CODE_SIZE, ITERS, TRIALS);
+	}
+}
+// CPU identification, which starts every CSV line
+static void report_csv_cpu() {
+	print_quoted(cpu_sig.vendor);
+	putchar(',');
+	print_quoted(cpu_sig.brand);
+	printf(",%08" PRIx32 ",%u,%u,%u,%s",
+		cpu_sig.signature, cpu_sig.family, cpu_sig.model, cpu_sig.stepping, report_mode);
+}
+#define REPORT_CSV_CPU_HEADER "vendor,brand,signature,family,model,stepping,mode"
+static void report_result(const test_result_t* result) {
+	if(output_format == FORMAT_TEXT) {
+		printf("%20s  %9" PRIu64 " rdtsc counts", result->name, result->min);
+		if(result->energy.available)
+			printf("  %9.3f uJ/KB  %.3g J*s EDP", result->energy.uj_per_kb[0], result->energy.edp);
+		printf("\n");
+	} else if(output_format == FORMAT_JSON) {
+		printf("%s\n    {\"strategy\": \"%s\", \"min\": %" PRIu64 ", \"median\": %" PRIu64 ", \"mean\": %" PRIu64 ", \"max\": %" PRIu64,
+			report_count ? "," : "", result->name, result->min, result->median, result->mean, result->max);
+		if(counters_active) {
+			printf(", \"counters\": {");
+			int first = 1;
+			for(int i=0; i<NUM_COUNTERS; i++) {
+				if(!counter_available(i)) continue;
+				printf("%s\"%s\": %" PRIu64, first ? "" : ", ", counter_names[i], result->counters[i]);
+				first = 0;
+			}
+			printf("}");
+		}
+		if(result->energy.available) {
+			printf(", \"energy\": {");
+			for(int i=0; i<NUM_RAPL_DOMAINS; i++)
+				if(result->energy.uj_per_kb[i] >= 0)
+					printf("\"%s_uj_per_kb\": %.4f, ", rapl_domain_names[i], result->energy.uj_per_kb[i]);
+			printf("\"edp\": %.6g}", result->energy.edp);
+		}
+		printf("}");
+	} else {
+		if(!report_count) {
+			printf(REPORT_CSV_CPU_HEADER ",strategy,code_size,iters,trials,min,median,mean,max");
+			for(int i=0; i<NUM_COUNTERS; i++)
+				printf(",%s", counter_names[i]);
+			for(int i=0; i<NUM_RAPL_DOMAINS; i++)
+				printf(",%s_uj_per_kb", rapl_domain_names[i]);
+			printf(",edp\n");
+		}
+		report_csv_cpu();
+		printf(",%s,%d,%d,%d,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64,
+			result->name, CODE_SIZE, ITERS, TRIALS, result->min, result->median, result->mean, result->max);
+		for(int i=0; i<NUM_COUNTERS; i++) {
+			if(counter_available(i))
+				printf(",%" PRIu64, result->counters[i]);
+			else
+				putchar(',');
+		}
+		for(int i=0; i<NUM_RAPL_DOMAINS; i++) {
+			if(result->energy.available && result->energy.uj_per_kb[i] >= 0)
+				printf(",%.4f", result->energy.uj_per_kb[i]);
+			else
+				putchar(',');
+		}
+		if(result->energy.available)
+			printf(",%.6g", result->energy.edp);
+		else
+			putchar(',');
+		printf("\n");
+	}
+	report_count++;
+}
+static void report_end() {
+	if(output_format == FORMAT_JSON)
+		printf("\n  ]\n}\n");
+}
+
+// modes which measure something other than plain timings report rows of named fields instead, between report_begin/report_end
+// CSV columns are taken from the first row, so every row needs the same fields, in the same order
+// text output is left to the mode, so these do nothing for it
+static char row_names[1024], row_values[2048];
+static size_t row_names_len, row_values_len;
+static void row_begin() {
+	row_names_len = row_values_len = 0;
+	row_names[0] = row_values[0] = 0;
+}
+static void row_field(const char* name, const char* value, int quote) {
+	if(output_format == FORMAT_TEXT) return;
+	const char* sep = row_values_len ? (output_format == FORMAT_JSON ? ", " : ",") : "";
+	row_names_len += snprintf(row_names + row_names_len, sizeof(row_names) - row_names_len, ",%s", name);
+	if(output_format == FORMAT_JSON)
+		row_values_len += snprintf(row_values + row_values_len, sizeof(row_values) - row_values_len,
+			quote ? "%s\"%s\": \"%s\"" : "%s\"%s\": %s", sep, name, value);
+	else if(quote && strpbrk(value, ",\""))
+		row_values_len += snprintf(row_values + row_values_len, sizeof(row_values) - row_values_len, "%s\"%s\"", sep, value); // names from this program never contain quotes
+	else
+		row_values_len += snprintf(row_values + row_values_len, sizeof(row_values) - row_values_len, "%s%s", sep, value);
+	if(row_names_len >= sizeof(row_names)) row_names_len = sizeof(row_names)-1;
+	if(row_values_len >= sizeof(row_values)) row_values_len = sizeof(row_values)-1;
+}
+static void row_str(const char* name, const char* value) {
+	row_field(name, value, 1);
+}
+static void row_int(const char* name, int64_t value) {
+	char buf[24];
+	snprintf(buf, sizeof(buf), "%" PRId64, value);
+	row_field(name, buf, 0);
+}
+static void row_float(const char* name, double value) {
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%.2f", value);
+	row_field(name, buf, 0);
+}
+// a field which doesn't apply to this row
+static void row_null(const char* name) {
+	row_field(name, output_format == FORMAT_JSON ? "null" : "", 0);
+}
+static void row_end() {
+	if(output_format == FORMAT_JSON) {
+		printf("%s\n    {%s}", report_count ? "," : "", row_values);
+	} else if(output_format == FORMAT_CSV) {
+		if(!report_count)
+			printf(REPORT_CSV_CPU_HEADER "%s\n", row_names);
+		report_csv_cpu();
+		printf(",%s\n", row_values);
+	} else
+		return;
+	report_count++;
+}
+
+
+/**************************************/
+// verification
+// the JIT'd code returns the sum of the immediates written, so we can check that the code executed is the code that was just written, and not a stale copy
+// keeping track of this changes the code generated for every strategy, so it's only compiled in with -DVERIFY; otherwise JIT'd code is just called
+
+#ifdef VERIFY
+# define VERIFY_ONLY(...) __VA_ARGS__
+static int verify_mode = 0;
+static uint32_t jit_expected = 0; // what the last written function should return
+static uint64_t verify_calls = 0, verify_failures = 0;
+
+// call JIT'd code with EAX zeroed, so that its return value is predictable
+static __inline__ uint32_t jit_call_zeroed(void* fn) {
+	uint32_t result;
+#if defined(__GNUC__) && defined(__x86_64__)
+	asm volatile(
+		"sub $128, %%rsp\n" // don't clobber the red zone
+		"call *%1\n"
+		"add $128, %%rsp\n"
+		: "=a"(result)
+		: "r"(fn), "0"(0)
+		: "cc", "memory"
+	);
+#elif defined(__GNUC__)
+	asm volatile(
+		"call *%1\n"
+		: "=a"(result)
+		: "r"(fn), "0"(0)
+		: "cc", "memory"
+	);
+#else
+	// can't control EAX, so treat the function as returning the correct result
+	((jitfunc_t)fn)();
+	result = jit_expected;
+#endif
+	return result;
+}
+static __inline__ void jit_call(void* fn) {
+	if(verify_mode) {
+		verify_calls++;
+		if(jit_call_zeroed(fn) != jit_expected)
+			verify_failures++;
+	} else
+		((jitfunc_t)fn)();
+}
+#else
+# define VERIFY_ONLY(...)
+# define jit_call(fn) ((jitfunc_t)(fn))()
+#endif
+
 
 /**************************************/
 // the JITting function
@@ -151,18 +703,22 @@ static uint64_t time_jit(stratfunc_t fn, void* dst) {
 static void write_code(void* dst, size_t offset) {
 	static uint32_t base = 0;
 	uint8_t* code = (uint8_t*)dst;
+	VERIFY_ONLY(uint32_t sum = 0;)
 	while(offset<CODE_SIZE-6) {
 		code[offset++] = 5; // ADD eax, imm
 		memcpy(code+offset, &base, 4); // immediate value
 		offset += 4;
+		VERIFY_ONLY(sum += base;)
 		base = base*2 + 1; // "random" transformation
 	}
 	code[offset] = 0xc3; // RET
+	VERIFY_ONLY(jit_expected = sum;)
 }
 // JIT code in reverse order
 static void write_code_reverse(void* dst) {
 	static uint32_t base = 0;
 	uint8_t* code = (uint8_t*)dst;
+	VERIFY_ONLY(uint32_t sum = 0;)
 	size_t p = CODE_SIZE-6;
 	p -= p%5;
 	code[p] = 0xc3; // RET
@@ -170,8 +726,10 @@ static void write_code_reverse(void* dst) {
 		p -= 5;
 		code[p] = 5; // ADD eax, imm
 		memcpy(code+p+1, &base, 4); // immediate value
+		VERIFY_ONLY(sum += base;)
 		base = base*2 + 1; // "random" transformation
 	}
+	VERIFY_ONLY(jit_expected = sum;)
 }
 
 
@@ -181,14 +739,16 @@ static void write_code_reverse(void* dst) {
 // do nothing special - base case
 static void jit_plain(void* dst) {
 	write_code(dst, 0);
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 
 // only write, don't execute; this is just to show the overhead of the CPU handling JIT condition
 static void* static_code = NULL;
+VERIFY_ONLY(static uint32_t static_code_expected;)
 static void jit_only_init() {
 	static_code = jit_alloc(CODE_SIZE);
 	write_code(static_code, 0);
+	VERIFY_ONLY(static_code_expected = jit_expected;)
 }
 static void jit_only(void* dst) {
 	(void)dst;
@@ -197,13 +757,14 @@ static void jit_only(void* dst) {
 	write_code(tmp, 0);
 	volatile char unused = ((char*)tmp)[CODE_SIZE-1]; // prevent compiler eliminating `write_code`
 	(void)unused;
-	((jitfunc_t)static_code)();
+	VERIFY_ONLY(jit_expected = static_code_expected;)
+	jit_call(static_code);
 }
 
 // write JIT code in reverse
 static void jit_reverse(void* dst) {
 	write_code_reverse(dst);
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 
 // JIT to temporary location on stack, then copy across to destination
@@ -211,7 +772,7 @@ static void jit_memcpy(void* dst) {
 	ALIGN_TO(64, char* tmp[CODE_SIZE]);
 	write_code(tmp, 0);
 	memcpy(dst, tmp, CODE_SIZE);
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 #ifdef __GNUC__
 // explicitly copy using REP MOVS
@@ -229,7 +790,7 @@ static void jit_memcpy_movsb(void* dst) {
 		: "memory"
 	);
 	
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 # ifdef __x86_64__
 static void jit_memcpy_movsq(void* dst) {
@@ -246,7 +807,7 @@ static void jit_memcpy_movsq(void* dst) {
 		: "memory"
 	);
 	
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 # endif
 #endif
@@ -257,14 +818,23 @@ static void jit_memcpy_sse2(void* dst) {
 	write_code(tmp, 0);
 	for(int i=0; i<((CODE_SIZE+15)&~15); i+=16)
 		_mm_store_si128((__m128i*)(dst + i), _mm_load_si128((__m128i*)((char*)tmp + i)));
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 static void jit_memcpy_sse2_nt(void* dst) {
 	ALIGN_TO(16, char* tmp[CODE_SIZE]);
 	write_code(tmp, 0);
 	for(int i=0; i<((CODE_SIZE+15)&~15); i+=16)
 		_mm_stream_si128((__m128i*)(dst + i), _mm_load_si128((__m128i*)((char*)tmp + i)));
-	((jitfunc_t)dst)();
+	jit_call(dst);
+}
+// the above doesn't fence the non-temporal stores before executing; check whether it makes a difference
+static void jit_memcpy_sse2_nt_sfence(void* dst) {
+	ALIGN_TO(16, char* tmp[CODE_SIZE]);
+	write_code(tmp, 0);
+	for(int i=0; i<((CODE_SIZE+15)&~15); i+=16)
+		_mm_stream_si128((__m128i*)(dst + i), _mm_load_si128((__m128i*)((char*)tmp + i)));
+	_mm_sfence();
+	jit_call(dst);
 }
 #ifdef __AVX__
 static void jit_memcpy_avx(void* dst) {
@@ -272,14 +842,14 @@ static void jit_memcpy_avx(void* dst) {
 	write_code(tmp, 0);
 	for(int i=0; i<((CODE_SIZE+31)&~31); i+=32)
 		_mm256_store_si256((__m256i*)(dst + i), _mm256_load_si256((__m256i*)((char*)tmp + i)));
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 static void jit_memcpy_avx_nt(void* dst) {
 	ALIGN_TO(32, char* tmp[CODE_SIZE]);
 	write_code(tmp, 0);
 	for(int i=0; i<((CODE_SIZE+31)&~31); i+=32)
 		_mm256_stream_si256((__m256i*)(dst + i), _mm256_load_si256((__m256i*)((char*)tmp + i)));
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 #endif
 #ifdef __AVX512F__
@@ -288,14 +858,14 @@ static void jit_memcpy_avx3(void* dst) {
 	write_code(tmp, 0);
 	for(int i=0; i<((CODE_SIZE+63)&~63); i+=64)
 		_mm512_store_si512(dst + i, _mm512_load_si512((char*)tmp + i));
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 static void jit_memcpy_avx3_nt(void* dst) {
 	ALIGN_TO(64, char* tmp[CODE_SIZE]);
 	write_code(tmp, 0);
 	for(int i=0; i<((CODE_SIZE+63)&~63); i+=64)
 		_mm512_stream_si512(dst + i, _mm512_load_si512((char*)tmp + i));
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 #endif
 
@@ -304,7 +874,7 @@ static void jit_memcpy_sse2_rev(void* dst) {
 	write_code(tmp, 0);
 	for(int i=((CODE_SIZE+15)&~15)-16; i>=0; i-=16)
 		_mm_store_si128((__m128i*)(dst + i), _mm_load_si128((__m128i*)((char*)tmp + i)));
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 #ifdef __AVX__
 static void jit_memcpy_avx_rev(void* dst) {
@@ -312,7 +882,7 @@ static void jit_memcpy_avx_rev(void* dst) {
 	write_code(tmp, 0);
 	for(int i=((CODE_SIZE+31)&~31)-32; i>=0; i-=32)
 		_mm256_store_si256((__m256i*)(dst + i), _mm256_load_si256((__m256i*)((char*)tmp + i)));
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 #endif
 #ifdef __AVX512F__
@@ -321,7 +891,7 @@ static void jit_memcpy_avx3_rev(void* dst) {
 	write_code(tmp, 0);
 	for(int i=((CODE_SIZE+63)&~63)-64; i>=0; i-=64)
 		_mm512_store_si512(dst + i, _mm512_load_si512((char*)tmp + i));
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 #endif
 
@@ -330,14 +900,14 @@ static void jit_memcpy_avx3_rev(void* dst) {
 static void jit_clr(void* dst) {
 	memset(dst, 0, CODE_SIZE);
 	write_code(dst, 0);
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 
 // fill memory with RET instruction before writing
 static void jit_clr_ret(void* dst) {
 	memset(dst, 0xC3, CODE_SIZE);
 	write_code(dst, 0);
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 
 #ifdef __GNUC__
@@ -352,7 +922,7 @@ static void jit_clr_stosb(void* dst) {
 		: "memory"
 	);
 	write_code(dst, 0);
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 # ifdef __x86_64__
 static void jit_clr_stosq(void* dst) {
@@ -365,7 +935,7 @@ static void jit_clr_stosq(void* dst) {
 		: "memory"
 	);
 	write_code(dst, 0);
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 # endif
 #endif
@@ -377,7 +947,7 @@ static void jit_clr_1byte(void* dst) {
 	//	memset(dst + i, 0, 1);
 	
 	write_code(dst, 0);
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 
 // clear two cachelines with a straddled 2-byte write
@@ -390,7 +960,7 @@ static void jit_clr_2byte(void* dst) {
 	//	memset(dst + i + 63, 0, 2);
 	
 	write_code(dst, 0);
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 
 #ifdef __AVX512F__
@@ -405,7 +975,7 @@ static void jit_clr_scatter(void* dst) {
 		), _mm512_setzero_si512(), 1);
 	
 	write_code(dst, 0);
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 #endif
 
@@ -414,14 +984,14 @@ static void jit_clr_sse2_nt(void* dst) {
 	for(int i=0; i<((CODE_SIZE+15)&~15); i+=16)
 		_mm_stream_si128((__m128i*)(dst + i), _mm_setzero_si128());
 	write_code(dst, 0);
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 // as above, but only 1 write per cacheline
 static void jit_clr_sse2_1nt(void* dst) {
 	for(int i=0; i<((CODE_SIZE+15)&~15); i+=64)
 		_mm_stream_si128((__m128i*)(dst + i), _mm_setzero_si128());
 	write_code(dst, 0);
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 // 256-bit versions of above
 #ifdef __AVX__
@@ -429,13 +999,13 @@ static void jit_clr_avx_nt(void* dst) {
 	for(int i=0; i<((CODE_SIZE+31)&~31); i+=32)
 		_mm256_stream_si256((__m256i*)(dst + i), _mm256_setzero_si256());
 	write_code(dst, 0);
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 static void jit_clr_avx_1nt(void* dst) {
 	for(int i=0; i<((CODE_SIZE+31)&~31); i+=64)
 		_mm256_stream_si256((__m256i*)(dst + i), _mm256_setzero_si256());
 	write_code(dst, 0);
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 #endif
 
@@ -445,7 +1015,7 @@ static void jit_clr_avx3_nt(void* dst) {
 	for(int i=0; i<((CODE_SIZE+63)&~63); i+=64)
 		_mm512_stream_si512(dst + i, _mm512_setzero_si512());
 	write_code(dst, 0);
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 #endif
 
@@ -453,21 +1023,21 @@ static void jit_clr_avx3_nt(void* dst) {
 static void jit_clr_reverse(void* dst) {
 	memset(dst, 0, CODE_SIZE);
 	write_code_reverse(dst);
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 // other reverse variants of above
 static void jit_clr_1byte_rev(void* dst) {
 	for(int i=0; i<CODE_SIZE; i+=64)
 		((char*)dst)[i] = 0;
 	write_code_reverse(dst);
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 static void jit_clr_2byte_rev(void* dst) {
 	uint16_t* code = (uint16_t*)((uint8_t*)dst + 63); // straddle cacheline boundary
 	for(int i=0; i<CODE_SIZE/2-33; i+=64)
 		code[i] = 0;
 	write_code_reverse(dst);
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 
 
@@ -479,7 +1049,7 @@ static void jit_clzero(void* dst) {
 		_mm_clzero(code + i);
 	
 	write_code(dst, 0);
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 #endif
 
@@ -491,7 +1061,7 @@ static void jit_cldemote(void* dst) {
 		_mm_cldemote(code + i);
 	
 	write_code(dst, 0);
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 // apply it before execution
 static void jit_cldemote_after(void* dst) {
@@ -499,7 +1069,7 @@ static void jit_cldemote_after(void* dst) {
 	uint8_t* code = (uint8_t*)dst;
 	for(int i=0; i<CODE_SIZE; i+=64)
 		_mm_cldemote(code + i);
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 #endif
 
@@ -511,14 +1081,14 @@ static void jit_clflush(void* dst) {
 		_mm_clflush(code + i);
 	
 	write_code(dst, 0);
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 static void jit_clflush_after(void* dst) {
 	write_code(dst, 0);
 	uint8_t* code = (uint8_t*)dst;
 	for(int i=0; i<CODE_SIZE; i+=64)
 		_mm_clflush(code + i);
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 
 #ifdef __CLFLUSHOPT__
@@ -529,14 +1099,14 @@ static void jit_clflushopt(void* dst) {
 		_mm_clflushopt(code + i);
 	
 	write_code(dst, 0);
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 static void jit_clflushopt_after(void* dst) {
 	write_code(dst, 0);
 	uint8_t* code = (uint8_t*)dst;
 	for(int i=0; i<CODE_SIZE; i+=64)
 		_mm_clflushopt(code + i);
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 #endif
 
@@ -548,7 +1118,7 @@ static void jit_prefetchw(void* dst) {
 		_mm_prefetch(code + i, _MM_HINT_ET1);
 	
 	write_code(dst, 0);
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 
 // PREFETCHT1 (L2 cache?) region before JIT
@@ -558,14 +1128,14 @@ static void jit_prefetcht1(void* dst) {
 		_mm_prefetch(code + i, _MM_HINT_T1);
 	
 	write_code(dst, 0);
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 static void jit_prefetcht1_after(void* dst) {
 	write_code(dst, 0);
 	uint8_t* code = (uint8_t*)dst;
 	for(int i=0; i<CODE_SIZE; i+=64)
 		_mm_prefetch(code + i, _MM_HINT_T1);
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 
 // write a single UD2 instruction at beginning, JIT, then write first instruction last
@@ -575,7 +1145,8 @@ static void jit_ud2(void* dst) {
 	// write ADD eax, imm
 	*(uint8_t*)dst = 5;
 	*(uint32_t*)((char*)dst+1) = 0x55555555;
-	((jitfunc_t)dst)();
+	VERIFY_ONLY(jit_expected += 0x55555555;)
+	jit_call(dst);
 }
 // as above, but also clear remaining
 static void jit_ud2_clr(void* dst) {
@@ -585,7 +1156,8 @@ static void jit_ud2_clr(void* dst) {
 	// write ADD eax, imm
 	*(uint8_t*)dst = 5;
 	*(uint32_t*)((char*)dst+1) = 0x55555555;
-	((jitfunc_t)dst)();
+	VERIFY_ONLY(jit_expected += 0x55555555;)
+	jit_call(dst);
 }
 static void jit_ud2_clr_1byte(void* dst) {
 	*(uint16_t*)dst = 0xb0f; // UD2
@@ -595,14 +1167,15 @@ static void jit_ud2_clr_1byte(void* dst) {
 	// write ADD eax, imm
 	*(uint8_t*)dst = 5;
 	*(uint32_t*)((char*)dst+1) = 0x55555555;
-	((jitfunc_t)dst)();
+	VERIFY_ONLY(jit_expected += 0x55555555;)
+	jit_call(dst);
 }
 
 // realloc a whole new region per JIT invocation (to demonstrate the cost of W^X)
 static void jit_realloc(void* dst) {
 	void* tmp = jit_alloc(CODE_SIZE);
 	write_code(tmp, 0);
-	((jitfunc_t)tmp)();
+	jit_call(tmp);
 	jit_free(tmp, CODE_SIZE);
 }
 
@@ -613,42 +1186,42 @@ static void jit_2region(void* regions) {
 	static unsigned cnt = 0;
 	void* dst = ((void**)regions)[cnt];
 	write_code(dst, 0);
-	((jitfunc_t)dst)();
+	jit_call(dst);
 	cnt = (cnt+1) % 2;
 }
 static void jit_4region(void* regions) {
 	static unsigned cnt = 0;
 	void* dst = ((void**)regions)[cnt];
 	write_code(dst, 0);
-	((jitfunc_t)dst)();
+	jit_call(dst);
 	cnt = (cnt+1) % 4;
 }
 static void jit_8region(void* regions) {
 	static unsigned cnt = 0;
 	void* dst = ((void**)regions)[cnt];
 	write_code(dst, 0);
-	((jitfunc_t)dst)();
+	jit_call(dst);
 	cnt = (cnt+1) % 8;
 }
 static void jit_16region(void* regions) {
 	static unsigned cnt = 0;
 	void* dst = ((void**)regions)[cnt];
 	write_code(dst, 0);
-	((jitfunc_t)dst)();
+	jit_call(dst);
 	cnt = (cnt+1) % 16;
 }
 static void jit_32region(void* regions) {
 	static unsigned cnt = 0;
 	void* dst = ((void**)regions)[cnt];
 	write_code(dst, 0);
-	((jitfunc_t)dst)();
+	jit_call(dst);
 	cnt = (cnt+1) % 32;
 }
 static void jit_64region(void* regions) {
 	static unsigned cnt = 0;
 	void* dst = ((void**)regions)[cnt];
 	write_code(dst, 0);
-	((jitfunc_t)dst)();
+	jit_call(dst);
 	cnt = (cnt+1) % 64;
 }
 
@@ -657,7 +1230,7 @@ static void jit_2region_flush(void* regions) {
 	static unsigned cnt = 0;
 	void* dst = ((void**)regions)[cnt];
 	write_code(dst, 0);
-	((jitfunc_t)dst)();
+	jit_call(dst);
 	
 	uint8_t* code = (uint8_t*)dst;
 	for(int i=0; i<CODE_SIZE; i+=64)
@@ -670,7 +1243,7 @@ static void jit_2region_flushopt(void* regions) {
 	static unsigned cnt = 0;
 	void* dst = ((void**)regions)[cnt];
 	write_code(dst, 0);
-	((jitfunc_t)dst)();
+	jit_call(dst);
 	
 	uint8_t* code = (uint8_t*)dst;
 	for(int i=0; i<CODE_SIZE; i+=64)
@@ -684,7 +1257,7 @@ static void jit_2region_clr(void* regions) {
 	static unsigned cnt = 0;
 	void* dst = ((void**)regions)[cnt];
 	write_code(dst, 0);
-	((jitfunc_t)dst)();
+	jit_call(dst);
 	
 	memset(dst, 0, CODE_SIZE);
 	
@@ -696,27 +1269,27 @@ extern void jmp32k(void);
 static void jit_jmp32k(void* dst) {
 	jmp32k();
 	write_code(dst, 0);
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 // as above, but align jump instructions to straddle cachelines, requiring half the number of jumps
 extern void jmp32k_u(void);
 static void jit_jmp32k_unalign(void* dst) {
 	jmp32k_u();
 	write_code(dst, 0);
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 // 64k versions of above
 extern void jmp64k(void);
 static void jit_jmp64k(void* dst) {
 	jmp64k();
 	write_code(dst, 0);
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 extern void jmp64k_u(void);
 static void jit_jmp64k_unalign(void* dst) {
 	jmp64k_u();
 	write_code(dst, 0);
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 
 
@@ -724,24 +1297,17 @@ static void jit_jmp64k_unalign(void* dst) {
 static void jit_mfence(void* dst) {
 	write_code(dst, 0);
 	_mm_mfence();
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 
 // does serializing do anything?
-#ifdef _MSC_VER
-# include <intrin.h>
-# define _cpuid __cpuid
-#else
-# include <cpuid.h>
-# define _cpuid(ar, eax) __cpuid(eax, ar[0], ar[1], ar[2], ar[3])
-#endif
 static void jit_serialize(void* dst) {
 	write_code(dst, 0);
 	int id[4];
 	_cpuid(id, 1);
 	volatile int unused = id[0];
 	(void)unused;
-	((jitfunc_t)dst)();
+	jit_call(dst);
 }
 
 // write and execute from different virtual addresses, mapped to the same physical page
@@ -754,148 +1320,2262 @@ static void jit_dual_mapping(void* dst) {
 	volatile int unused = id[0];
 	(void)unused;
 	
-	((jitfunc_t)pair->xmem)();
+	jit_call(pair->xmem);
+}
+// as above, without the serializing instruction, which appears to be unnecessary in practice
+static void jit_dual_mapping_nosync(void* dst) {
+	jit_wx_pair* pair = (jit_wx_pair*)dst;
+	write_code(pair->wmem, 0);
+	jit_call(pair->xmem);
 }
 
 
-int main(void) {
-	void* dst[NUM_REGIONS];
-	for(int i=0; i<NUM_REGIONS; i++) {
-		void* region = jit_alloc(CODE_SIZE);
-		if(!region) {
-			printf("Failed to allocate write+execute page\n");
-			return 1;
+// fused emit + mitigate: rather than a separate pass over the region before/after JIT'ing, apply the mitigation a cacheline at a time as code is written
+enum { FUSED_CLR_AHEAD, FUSED_CLFLUSHOPT, FUSED_CLDEMOTE };
+static int fused_distance = 4; // how many cachelines ahead of the write cursor to clear
+static void write_code_fused(void* dst, int mode) {
+	static uint32_t base = 0;
+	uint8_t* code = (uint8_t*)dst;
+	VERIFY_ONLY(uint32_t sum = 0;)
+	size_t offset = 0;
+	int lines = (CODE_SIZE+63)/64;
+	int done = 0; // lines fully written
+	int cleared = 0; // lines cleared so far
+	while(offset<CODE_SIZE-6) {
+		if(mode == FUSED_CLR_AHEAD) {
+			// make sure lines up to the end of this instruction, plus the lookahead distance, have been cleared
+			int target = (int)((offset+4)/64) + fused_distance;
+			if(target >= lines) target = lines-1;
+			for(; cleared<=target; cleared++)
+				code[cleared*64] = 0;
 		}
-		if((uintptr_t)region & 63) {
-			printf("Allocated page isn't cacheline aligned?!\n");
-			return 1;
+		code[offset++] = 5; // ADD eax, imm
+		memcpy(code+offset, &base, 4); // immediate value
+		offset += 4;
+		VERIFY_ONLY(sum += base;)
+		base = base*2 + 1; // "random" transformation
+		
+		// act on lines as soon as they're complete
+		for(; done < (int)(offset/64); done++) {
+#ifdef __CLFLUSHOPT__
+			if(mode == FUSED_CLFLUSHOPT) _mm_clflushopt(code + done*64);
+#endif
+#ifdef __CLDEMOTE__
+			if(mode == FUSED_CLDEMOTE) _mm_cldemote(code + done*64);
+#endif
 		}
-		dst[i] = region;
+	}
+	code[offset] = 0xc3; // RET
+	for(; done < lines; done++) {
+#ifdef __CLFLUSHOPT__
+		if(mode == FUSED_CLFLUSHOPT) _mm_clflushopt(code + done*64);
+#endif
+#ifdef __CLDEMOTE__
+		if(mode == FUSED_CLDEMOTE) _mm_cldemote(code + done*64);
+#endif
+	}
+	VERIFY_ONLY(jit_expected = sum;)
+}
+static void jit_fused_clr_ahead(void* dst) {
+	write_code_fused(dst, FUSED_CLR_AHEAD);
+	jit_call(dst);
+}
+#ifdef __CLFLUSHOPT__
+static void jit_fused_clflushopt(void* dst) {
+	write_code_fused(dst, FUSED_CLFLUSHOPT);
+	jit_call(dst);
+}
+#endif
+#ifdef __CLDEMOTE__
+static void jit_fused_cldemote(void* dst) {
+	write_code_fused(dst, FUSED_CLDEMOTE);
+	jit_call(dst);
+}
+#endif
+
+// JIT into a one cacheline buffer, streaming each line out with non-temporal writes once it's full
+// this only needs 128 bytes of staging space, vs the full function size for jit_memcpy_sse2_nt
+#define FUSED_NT_STAGING 128
+static void jit_fused_nt(void* dst) {
+	static uint32_t base = 0;
+	ALIGN_TO(16, uint8_t buf[FUSED_NT_STAGING]); // one line, plus room for an instruction spilling over
+	uint8_t* code = (uint8_t*)dst;
+	VERIFY_ONLY(uint32_t sum = 0;)
+	size_t offset = 0, pos = 0;
+	while(offset<CODE_SIZE-6) {
+		buf[pos] = 5; // ADD eax, imm
+		memcpy(buf+pos+1, &base, 4); // immediate value
+		pos += 5;
+		offset += 5;
+		VERIFY_ONLY(sum += base;)
+		base = base*2 + 1; // "random" transformation
+		
+		if(pos >= 64) {
+			uint8_t* line = code + (offset - pos);
+			for(int i=0; i<64; i+=16)
+				_mm_stream_si128((__m128i*)(line + i), _mm_load_si128((__m128i*)(buf + i)));
+			memcpy(buf, buf+64, pos-64);
+			pos -= 64;
+		}
+	}
+	buf[pos] = 0xc3; // RET
+	// flush out the remaining lines
+	uint8_t* line = code + (offset - pos);
+	for(; line < code + CODE_SIZE; line += 64) {
+		for(int i=0; i<64; i+=16)
+			_mm_stream_si128((__m128i*)(line + i), _mm_load_si128((__m128i*)(buf + i)));
+		memset(buf, 0, 64);
+	}
+	VERIFY_ONLY(jit_expected = sum;)
+	jit_call(dst);
+}
+
+
+/**************************************/
+// composable strategies
+// rather than hand-writing each combination of techniques, build a strategy from independent stages, and search through the combinations
+
+enum {
+	PRE_NONE, PRE_CLR, PRE_CLR_1BYTE, PRE_PREFETCHW, PRE_CLDEMOTE, PRE_CLFLUSHOPT, PRE_UD2,
+	NUM_PRE
+};
+enum {
+	EMIT_DIRECT, EMIT_MEMCPY, EMIT_SSE2_NT, EMIT_MOVSB,
+	NUM_EMIT
+};
+enum {
+	POST_NONE, POST_CLFLUSHOPT, POST_MFENCE, POST_SERIALIZE,
+	NUM_POST
+};
+static const char* combo_pre_names[NUM_PRE] = {
+	"none", "clr", "clr_1byte", "prefetchw", "cldemote", "clflushopt", "ud2"
+};
+static const char* combo_emit_names[NUM_EMIT] = {
+	"direct", "memcpy", "sse2_nt", "movsb"
+};
+static const char* combo_post_names[NUM_POST] = {
+	"none", "clflushopt", "mfence", "serialize"
+};
+static const int combo_rings[] = {1, 2, 4, 16};
+#define NUM_RINGS (sizeof(combo_rings)/sizeof(combo_rings[0]))
+
+// skip stages the compiler/CPU can't do
+static int combo_pre_available(int pre) {
+#ifndef __CLDEMOTE__
+	if(pre == PRE_CLDEMOTE) return 0;
+#endif
+#ifndef __CLFLUSHOPT__
+	if(pre == PRE_CLFLUSHOPT) return 0;
+#endif
+	(void)pre;
+	return 1;
+}
+static int combo_emit_available(int emit) {
+#ifndef __GNUC__
+	if(emit == EMIT_MOVSB) return 0;
+#endif
+	(void)emit;
+	return 1;
+}
+static int combo_post_available(int post) {
+#ifndef __CLFLUSHOPT__
+	if(post == POST_CLFLUSHOPT) return 0;
+#endif
+	(void)post;
+	return 1;
+}
+
+typedef struct {
+	int pre, emit, post, ring;
+	void** regions;
+	unsigned cnt;
+	char name[64];
+} combo_t;
+
+// copy whole cachelines from the temporary buffer to the executable region
+static void combo_copy(int emit, void* dst, const void* src, size_t len) {
+	switch(emit) {
+		case EMIT_MEMCPY:
+			memcpy(dst, src, len);
+		break;
+		case EMIT_SSE2_NT:
+			for(size_t i=0; i<len; i+=16)
+				_mm_stream_si128((__m128i*)((char*)dst + i), _mm_load_si128((__m128i*)((char*)src + i)));
+		break;
+#ifdef __GNUC__
+		case EMIT_MOVSB: {
+			void* tmpDst = dst;
+			const void* tmpSrc = src;
+			asm volatile(
+				"rep movsb\n"
+				: "+c"(len), "+S"(tmpSrc), "+D"(tmpDst)
+				: 
+				: "memory"
+			);
+		} break;
+#endif
+	}
+}
+
+static void jit_combo(void* ctx) {
+	combo_t* combo = (combo_t*)ctx;
+	void* dst = combo->regions[combo->cnt];
+	uint8_t* code = (uint8_t*)dst;
+	size_t offset = 0;
+	
+	switch(combo->pre) {
+		case PRE_CLR:
+			memset(dst, 0, CODE_SIZE);
+		break;
+		case PRE_CLR_1BYTE:
+			for(int i=0; i<CODE_SIZE; i+=64)
+				code[i] = 0;
+		break;
+		case PRE_PREFETCHW:
+			for(int i=0; i<CODE_SIZE; i+=64)
+				_mm_prefetch(code + i, _MM_HINT_ET1);
+		break;
+#ifdef __CLDEMOTE__
+		case PRE_CLDEMOTE:
+			for(int i=0; i<CODE_SIZE; i+=64)
+				_mm_cldemote(code + i);
+		break;
+#endif
+#ifdef __CLFLUSHOPT__
+		case PRE_CLFLUSHOPT:
+			for(int i=0; i<CODE_SIZE; i+=64)
+				_mm_clflushopt(code + i);
+		break;
+#endif
+		case PRE_UD2:
+			*(uint16_t*)dst = 0xb0f; // UD2
+			offset = 5;
+		break;
 	}
 	
+	if(combo->emit == EMIT_DIRECT) {
+		write_code(dst, offset);
+	} else {
+		ALIGN_TO(64, char tmp[CODE_SIZE]);
+		write_code(tmp, offset);
+		if(offset) {
+			// copy everything but the first cacheline, then fill that in without touching the UD2
+			combo_copy(combo->emit, code + 64, tmp + 64, CODE_SIZE - 64);
+			memcpy(code + 2, tmp + 2, 62);
+		} else
+			combo_copy(combo->emit, dst, tmp, CODE_SIZE);
+	}
+	if(offset) {
+		// write ADD eax, imm
+		*(uint8_t*)dst = 5;
+		*(uint32_t*)((char*)dst+1) = 0x55555555;
+		VERIFY_ONLY(jit_expected += 0x55555555;)
+	}
 	
-	jit_wx_pair wx_pair = {0};
-	jit_alloc_wx_alias(CODE_SIZE, &wx_pair.wmem, &wx_pair.xmem);
-	if(!wx_pair.wmem) {
-		printf("Failed to allocate shared page\n");
-		return 1;
+	switch(combo->post) {
+#ifdef __CLFLUSHOPT__
+		case POST_CLFLUSHOPT:
+			for(int i=0; i<CODE_SIZE; i+=64)
+				_mm_clflushopt(code + i);
+		break;
+#endif
+		case POST_MFENCE:
+			_mm_mfence();
+		break;
+		case POST_SERIALIZE: {
+			int id[4];
+			_cpuid(id, 1);
+			volatile int unused = id[0];
+			(void)unused;
+		} break;
 	}
 	
-	jit_only_init();
+	jit_call(dst);
+	combo->cnt = (combo->cnt+1) % combo->ring;
+}
+
+// search the combination space via successive halving: time every candidate with a few trials, drop the slower half, and repeat with more trials on the survivors
+#define COMBO_FINALISTS 10
+static void run_combo_search(void** regions) {
+	int num = 0;
+	combo_t* combos = (combo_t*)malloc(NUM_PRE * NUM_EMIT * NUM_POST * NUM_RINGS * sizeof(combo_t));
+	for(int pre=0; pre<NUM_PRE; pre++) {
+		if(!combo_pre_available(pre)) continue;
+		for(int emit=0; emit<NUM_EMIT; emit++) {
+			if(!combo_emit_available(emit)) continue;
+			for(int post=0; post<NUM_POST; post++) {
+				if(!combo_post_available(post)) continue;
+				for(unsigned ring=0; ring<NUM_RINGS; ring++) {
+					combo_t* c = combos + num++;
+					c->pre = pre;
+					c->emit = emit;
+					c->post = post;
+					c->ring = combo_rings[ring];
+					c->regions = regions;
+					c->cnt = 0;
+					snprintf(c->name, sizeof(c->name), "%s+%s+%s@%d",
+						combo_pre_names[pre], combo_emit_names[emit], combo_post_names[post], c->ring);
+				}
+			}
+		}
+	}
 	
-	uint64_t times[100];
-	memset(times, 0xff, sizeof(times));
+	// entries are (time << 16 | index), so that sorting by time keeps track of which combination it belongs to
+	uint64_t* ranking = (uint64_t*)malloc(num * sizeof(uint64_t));
+	int* alive = (int*)malloc(num * sizeof(int));
+	for(int i=0; i<num; i++)
+		alive[i] = i;
+	int num_alive = num;
+	int trials = 1;
+	fprintf(stderr, "Searching %d combinations\n", num);
+	while(num_alive > COMBO_FINALISTS) {
+		for(int i=0; i<num_alive; i++) {
+			uint64_t best = ~0ULL;
+			for(int t=0; t<trials; t++) {
+				uint64_t time = time_jit(jit_combo, combos + alive[i]);
+				if(time < best) best = time;
+			}
+			if(best > (~0ULL >> 16)) best = ~0ULL >> 16;
+			ranking[i] = best << 16 | alive[i];
+		}
+		qsort(ranking, num_alive, sizeof(uint64_t), cmp_u64);
+		num_alive /= 2;
+		if(num_alive < COMBO_FINALISTS) num_alive = COMBO_FINALISTS;
+		for(int i=0; i<num_alive; i++)
+			alive[i] = ranking[i] & 0xffff;
+		trials *= 2;
+		fprintf(stderr, "  %d remaining\n", num_alive);
+	}
 	
-	int trial = TRIALS;
-	while(trial--) {
-		int test = 0;
-		// to reduce variability, try to sample the fastest time
-		#define DO_TIME_TEST(fn, dst) { \
-			uint64_t time = time_jit(fn, dst); \
-			if(times[test] > time) times[test] = time; \
-			if(!trial) \
-				printf("%20s  %9" PRIu64 " rdtsc counts\n", #fn, times[test]); \
-			test++; \
+	// full measurement of the finalists, alongside the reference points
+	uint64_t samples[COMBO_FINALISTS + 2][TRIALS];
+	test_result_t results[COMBO_FINALISTS + 2];
+	memset(results, 0, sizeof(results));
+	for(int trial=0; trial<TRIALS; trial++) {
+		for(int i=0; i<num_alive+2; i++) {
+			uint64_t time;
+			if(i == 0)
+				time = time_jit(jit_plain, regions[0]);
+			else if(i == 1)
+				time = time_jit(jit_only, regions[0]);
+			else
+				time = time_jit(jit_combo, combos + alive[i-2]);
+			samples[i][trial] = time;
+			if(!trial || time < results[i].min) {
+				results[i].min = time;
+				memcpy(results[i].counters, counter_values, sizeof(counter_values));
+			}
 		}
-		
-		DO_TIME_TEST(jit_plain, dst[0]);
-		DO_TIME_TEST(jit_only, dst[0]);
-		DO_TIME_TEST(jit_reverse, dst[0]);
-		DO_TIME_TEST(jit_memcpy, dst[0]);
-		#ifdef __GNUC__
-		DO_TIME_TEST(jit_memcpy_movsb, dst[0]);
-		# ifdef __x86_64__
-		DO_TIME_TEST(jit_memcpy_movsq, dst[0]);
-		# endif
-		#endif
-		DO_TIME_TEST(jit_memcpy_sse2, dst[0]);
-		DO_TIME_TEST(jit_memcpy_sse2_nt, dst[0]);
-		#ifdef __AVX__
-		DO_TIME_TEST(jit_memcpy_avx, dst[0]);
-		DO_TIME_TEST(jit_memcpy_avx_nt, dst[0]);
-		#endif
-		#ifdef __AVX512F__
-		DO_TIME_TEST(jit_memcpy_avx3, dst[0]);
-		DO_TIME_TEST(jit_memcpy_avx3_nt, dst[0]);
-		#endif
-		DO_TIME_TEST(jit_memcpy_sse2_rev, dst[0]);
-		#ifdef __AVX__
-		DO_TIME_TEST(jit_memcpy_avx_rev, dst[0]);
-		#endif
-		#ifdef __AVX512F__
-		DO_TIME_TEST(jit_memcpy_avx3_rev, dst[0]);
-		#endif
-		DO_TIME_TEST(jit_clr, dst[0]);
-		DO_TIME_TEST(jit_clr_ret, dst[0]);
-		#ifdef __GNUC__
-		DO_TIME_TEST(jit_clr_stosb, dst[0]);
-		# ifdef __x86_64__
-		DO_TIME_TEST(jit_clr_stosq, dst[0]);
-		# endif
-		#endif
-		DO_TIME_TEST(jit_clr_1byte, dst[0]);
-		DO_TIME_TEST(jit_clr_2byte, dst[0]);
-		#ifdef __AVX512F__
-		DO_TIME_TEST(jit_clr_scatter, dst[0]);
-		#endif
-		DO_TIME_TEST(jit_clr_sse2_nt, dst[0]);
-		DO_TIME_TEST(jit_clr_sse2_1nt, dst[0]);
-		#ifdef __AVX__
-		DO_TIME_TEST(jit_clr_avx_nt, dst[0]);
-		DO_TIME_TEST(jit_clr_avx_1nt, dst[0]);
-		#endif
-		#ifdef __AVX512F__
-		DO_TIME_TEST(jit_clr_avx3_nt, dst[0]);
-		#endif
-		DO_TIME_TEST(jit_clr_reverse, dst[0]);
-		DO_TIME_TEST(jit_clr_1byte_rev, dst[0]);
-		DO_TIME_TEST(jit_clr_2byte_rev, dst[0]);
-		#ifdef __CLZERO__
-		DO_TIME_TEST(jit_clzero, dst[0]);
-		#endif
-		#ifdef __CLDEMOTE__
-		DO_TIME_TEST(jit_cldemote, dst[0]);
-		DO_TIME_TEST(jit_cldemote_after, dst[0]);
-		#endif
-		DO_TIME_TEST(jit_clflush, dst[0]);
-		DO_TIME_TEST(jit_clflush_after, dst[0]);
-		#ifdef __CLFLUSHOPT__
-		DO_TIME_TEST(jit_clflushopt, dst[0]);
-		DO_TIME_TEST(jit_clflushopt_after, dst[0]);
-		#endif
-		//#ifdef __PREFETCHWT1__
-		DO_TIME_TEST(jit_prefetchw, dst[0]);
-		//#endif
-		DO_TIME_TEST(jit_prefetcht1, dst[0]);
-		DO_TIME_TEST(jit_prefetcht1_after, dst[0]);
-		DO_TIME_TEST(jit_ud2, dst[0]);
-		DO_TIME_TEST(jit_ud2_clr, dst[0]);
-		DO_TIME_TEST(jit_ud2_clr_1byte, dst[0]);
-		DO_TIME_TEST(jit_2region, dst);
-		DO_TIME_TEST(jit_4region, dst);
-		DO_TIME_TEST(jit_8region, dst);
-		DO_TIME_TEST(jit_16region, dst);
-		DO_TIME_TEST(jit_32region, dst);
-		DO_TIME_TEST(jit_64region, dst);
-		DO_TIME_TEST(jit_2region_flush, dst);
-		#ifdef __CLFLUSHOPT__
-		DO_TIME_TEST(jit_2region_flushopt, dst);
-		#endif
-		DO_TIME_TEST(jit_2region_clr, dst);
-		DO_TIME_TEST(jit_jmp32k, dst[0]);
-		DO_TIME_TEST(jit_jmp32k_unalign, dst[0]);
-		DO_TIME_TEST(jit_jmp64k, dst[0]);
-		DO_TIME_TEST(jit_jmp64k_unalign, dst[0]);
-		DO_TIME_TEST(jit_mfence, dst[0]);
-		DO_TIME_TEST(jit_serialize, dst[0]);
-		DO_TIME_TEST(jit_dual_mapping, &wx_pair);
-		DO_TIME_TEST(jit_realloc, dst[0]);
 	}
+	results[0].name = "jit_plain";
+	results[1].name = "jit_only";
+	for(int i=0; i<num_alive; i++)
+		results[i+2].name = combos[alive[i]].name;
+	for(int i=0; i<num_alive+2; i++)
+		summarise_samples(results + i, samples[i], TRIALS);
+	
+	// sort finalists by fastest time
+	for(int i=3; i<num_alive+2; i++) {
+		test_result_t r = results[i];
+		int j = i;
+		for(; j>2 && results[j-1].min > r.min; j--)
+			results[j] = results[j-1];
+		results[j] = r;
+	}
+	
+	report_begin("combo");
+	for(int i=0; i<num_alive+2; i++)
+		report_result(results + i);
+	report_end();
+	
+	free(alive);
+	free(ranking);
+	free(combos);
+}
+
+
+// list of all strategies above, and what they take as an argument
+enum { ARG_REGION, ARG_REGIONS, ARG_WX_PAIR };
+typedef struct {
+	const char* name;
+	stratfunc_t fn;
+	int arg;
+	int unsynced; // doesn't synchronise before executing, so may run stale code (see --verify); not a real solution
+} strategy_t;
+#define STRATEGY(fn, arg) { #fn, fn, arg, 0 }
+#define STRATEGY_UNSYNCED(fn, arg) { #fn, fn, arg, 1 }
+static const strategy_t strategies[] = {
+	STRATEGY(jit_plain, ARG_REGION),
+	STRATEGY(jit_only, ARG_REGION),
+	STRATEGY(jit_reverse, ARG_REGION),
+	STRATEGY(jit_memcpy, ARG_REGION),
+#ifdef __GNUC__
+	STRATEGY(jit_memcpy_movsb, ARG_REGION),
+# ifdef __x86_64__
+	STRATEGY(jit_memcpy_movsq, ARG_REGION),
+# endif
+#endif
+	STRATEGY(jit_memcpy_sse2, ARG_REGION),
+	STRATEGY_UNSYNCED(jit_memcpy_sse2_nt, ARG_REGION),
+	STRATEGY(jit_memcpy_sse2_nt_sfence, ARG_REGION),
+#ifdef __AVX__
+	STRATEGY(jit_memcpy_avx, ARG_REGION),
+	STRATEGY_UNSYNCED(jit_memcpy_avx_nt, ARG_REGION),
+#endif
+#ifdef __AVX512F__
+	STRATEGY(jit_memcpy_avx3, ARG_REGION),
+	STRATEGY_UNSYNCED(jit_memcpy_avx3_nt, ARG_REGION),
+#endif
+	STRATEGY(jit_memcpy_sse2_rev, ARG_REGION),
+#ifdef __AVX__
+	STRATEGY(jit_memcpy_avx_rev, ARG_REGION),
+#endif
+#ifdef __AVX512F__
+	STRATEGY(jit_memcpy_avx3_rev, ARG_REGION),
+#endif
+	STRATEGY(jit_clr, ARG_REGION),
+	STRATEGY(jit_clr_ret, ARG_REGION),
+#ifdef __GNUC__
+	STRATEGY(jit_clr_stosb, ARG_REGION),
+# ifdef __x86_64__
+	STRATEGY(jit_clr_stosq, ARG_REGION),
+# endif
+#endif
+	STRATEGY(jit_clr_1byte, ARG_REGION),
+	STRATEGY(jit_clr_2byte, ARG_REGION),
+#ifdef __AVX512F__
+	STRATEGY(jit_clr_scatter, ARG_REGION),
+#endif
+	STRATEGY(jit_clr_sse2_nt, ARG_REGION),
+	STRATEGY(jit_clr_sse2_1nt, ARG_REGION),
+#ifdef __AVX__
+	STRATEGY(jit_clr_avx_nt, ARG_REGION),
+	STRATEGY(jit_clr_avx_1nt, ARG_REGION),
+#endif
+#ifdef __AVX512F__
+	STRATEGY(jit_clr_avx3_nt, ARG_REGION),
+#endif
+	STRATEGY(jit_clr_reverse, ARG_REGION),
+	STRATEGY(jit_clr_1byte_rev, ARG_REGION),
+	STRATEGY(jit_clr_2byte_rev, ARG_REGION),
+#ifdef __CLZERO__
+	STRATEGY(jit_clzero, ARG_REGION),
+#endif
+#ifdef __CLDEMOTE__
+	STRATEGY(jit_cldemote, ARG_REGION),
+	STRATEGY(jit_cldemote_after, ARG_REGION),
+#endif
+	STRATEGY(jit_clflush, ARG_REGION),
+	STRATEGY(jit_clflush_after, ARG_REGION),
+#ifdef __CLFLUSHOPT__
+	STRATEGY(jit_clflushopt, ARG_REGION),
+	STRATEGY(jit_clflushopt_after, ARG_REGION),
+#endif
+//#ifdef __PREFETCHWT1__
+	STRATEGY(jit_prefetchw, ARG_REGION),
+//#endif
+	STRATEGY(jit_prefetcht1, ARG_REGION),
+	STRATEGY(jit_prefetcht1_after, ARG_REGION),
+	STRATEGY(jit_ud2, ARG_REGION),
+	STRATEGY(jit_ud2_clr, ARG_REGION),
+	STRATEGY(jit_ud2_clr_1byte, ARG_REGION),
+	STRATEGY(jit_2region, ARG_REGIONS),
+	STRATEGY(jit_4region, ARG_REGIONS),
+	STRATEGY(jit_8region, ARG_REGIONS),
+	STRATEGY(jit_16region, ARG_REGIONS),
+	STRATEGY(jit_32region, ARG_REGIONS),
+	STRATEGY(jit_64region, ARG_REGIONS),
+	STRATEGY(jit_2region_flush, ARG_REGIONS),
+#ifdef __CLFLUSHOPT__
+	STRATEGY(jit_2region_flushopt, ARG_REGIONS),
+#endif
+	STRATEGY(jit_2region_clr, ARG_REGIONS),
+	STRATEGY(jit_jmp32k, ARG_REGION),
+	STRATEGY(jit_jmp32k_unalign, ARG_REGION),
+	STRATEGY(jit_jmp64k, ARG_REGION),
+	STRATEGY(jit_jmp64k_unalign, ARG_REGION),
+	STRATEGY(jit_mfence, ARG_REGION),
+	STRATEGY(jit_serialize, ARG_REGION),
+	STRATEGY(jit_dual_mapping, ARG_WX_PAIR),
+	STRATEGY_UNSYNCED(jit_dual_mapping_nosync, ARG_WX_PAIR),
+	STRATEGY(jit_fused_clr_ahead, ARG_REGION),
+#ifdef __CLFLUSHOPT__
+	STRATEGY(jit_fused_clflushopt, ARG_REGION),
+#endif
+#ifdef __CLDEMOTE__
+	STRATEGY(jit_fused_cldemote, ARG_REGION),
+#endif
+	STRATEGY_UNSYNCED(jit_fused_nt, ARG_REGION),
+	STRATEGY(jit_realloc, ARG_REGION),
+};
+#define NUM_STRATEGIES (sizeof(strategies)/sizeof(strategies[0]))
+
+/**************************************/
+// strategies at other function sizes
+// the compiler optimises each strategy for CODE_SIZE (e.g. inlining memset/memcpy), so the sweeps over function size use copies of a few representative strategies, built the same way for each size
+
+typedef struct {
+	int size;
+	void (*write)(void* dst); // write_code() for this size
+	strategy_t strategies[6];
+} sized_set_t;
+#define NUM_SIZED_STRATEGIES (sizeof(((sized_set_t*)0)->strategies)/sizeof(strategy_t))
+
+#define SIZED_SET(size) \
+static void write_code_##size(void* dst) { \
+	static uint32_t base = 0; \
+	uint8_t* code = (uint8_t*)dst; \
+	VERIFY_ONLY(uint32_t sum = 0;) \
+	size_t offset = 0; \
+	while(offset<size-6) { \
+		code[offset++] = 5; /* ADD eax, imm */ \
+		memcpy(code+offset, &base, 4); /* immediate value */ \
+		offset += 4; \
+		VERIFY_ONLY(sum += base;) \
+		base = base*2 + 1; /* "random" transformation */ \
+	} \
+	code[offset] = 0xc3; /* RET */ \
+	VERIFY_ONLY(jit_expected = sum;) \
+} \
+static void jit_plain_##size(void* dst) { \
+	write_code_##size(dst); \
+	jit_call(dst); \
+} \
+static void jit_only_##size(void* dst) { \
+	static void* static_code = NULL; \
+	VERIFY_ONLY(static uint32_t static_code_expected;) \
+	(void)dst; \
+	if(!static_code) { \
+		static_code = jit_alloc(size); \
+		write_code_##size(static_code); \
+		VERIFY_ONLY(static_code_expected = jit_expected;) \
+	} \
+	ALIGN_TO(64, uint8_t tmp[size]); \
+	write_code_##size(tmp); \
+	volatile uint8_t unused = tmp[size-1]; \
+	(void)unused; \
+	VERIFY_ONLY(jit_expected = static_code_expected;) \
+	jit_call(static_code); \
+} \
+static void jit_memcpy_##size(void* dst) { \
+	ALIGN_TO(64, uint8_t tmp[size]); \
+	write_code_##size(tmp); \
+	memcpy(dst, tmp, size); \
+	jit_call(dst); \
+} \
+static void jit_memcpy_sse2_nt_##size(void* dst) { \
+	ALIGN_TO(16, uint8_t tmp[size]); \
+	write_code_##size(tmp); \
+	for(int i=0; i<size; i+=16) \
+		_mm_stream_si128((__m128i*)((char*)dst + i), _mm_load_si128((__m128i*)(tmp + i))); \
+	jit_call(dst); \
+} \
+static void jit_memcpy_sse2_nt_sfence_##size(void* dst) { \
+	ALIGN_TO(16, uint8_t tmp[size]); \
+	write_code_##size(tmp); \
+	for(int i=0; i<size; i+=16) \
+		_mm_stream_si128((__m128i*)((char*)dst + i), _mm_load_si128((__m128i*)(tmp + i))); \
+	_mm_sfence(); \
+	jit_call(dst); \
+} \
+static void jit_clr_1byte_##size(void* dst) { \
+	for(int i=0; i<size; i+=64) \
+		((char*)dst)[i] = 0; \
+	write_code_##size(dst); \
+	jit_call(dst); \
+} \
+static const sized_set_t sized_set_##size = { size, write_code_##size, { \
+	{ "jit_plain", jit_plain_##size, ARG_REGION, 0 }, \
+	{ "jit_only", jit_only_##size, ARG_REGION, 0 }, \
+	{ "jit_memcpy", jit_memcpy_##size, ARG_REGION, 0 }, \
+	{ "jit_memcpy_sse2_nt", jit_memcpy_sse2_nt_##size, ARG_REGION, 1 }, \
+	{ "jit_memcpy_sse2_nt_sfence", jit_memcpy_sse2_nt_sfence_##size, ARG_REGION, 0 }, \
+	{ "jit_clr_1byte", jit_clr_1byte_##size, ARG_REGION, 0 } \
+} };
+
+SIZED_SET(256)
+SIZED_SET(1024)
+SIZED_SET(4096)
+SIZED_SET(16384)
+SIZED_SET(65536)
+#undef SIZED_SET
+
+static stratfunc_t sized_strategy(const sized_set_t* set, const char* name) {
+	for(unsigned i=0; i<NUM_SIZED_STRATEGIES; i++)
+		if(!strcmp(set->strategies[i].name, name))
+			return set->strategies[i].fn;
+	return NULL;
+}
+
+static void* strategy_arg(const strategy_t* strat, void** dst, jit_wx_pair* wx_pair) {
+	if(strat->arg == ARG_REGIONS) return dst;
+	if(strat->arg == ARG_WX_PAIR) return wx_pair;
+	return dst[0];
+}
+
+// run all the strategies above
+static void run_strategies(void** dst, jit_wx_pair* wx_pair) {
+	uint64_t times[NUM_STRATEGIES];
+	uint64_t samples[NUM_STRATEGIES][TRIALS];
+	test_result_t results[NUM_STRATEGIES];
+	memset(times, 0xff, sizeof(times));
+	memset(results, 0, sizeof(results));
+	
+	report_begin("strategies");
+	int trial = TRIALS;
+	while(trial--) {
+		// to reduce variability, try to sample the fastest time
+		for(unsigned test=0; test<NUM_STRATEGIES; test++) {
+			const strategy_t* strat = strategies + test;
+			uint64_t time = time_jit(strat->fn, strategy_arg(strat, dst, wx_pair));
+			samples[test][trial] = time;
+			if(times[test] > time) {
+				times[test] = time;
+				memcpy(results[test].counters, counter_values, sizeof(counter_values));
+			}
+			if(!trial) {
+				results[test].name = strat->name;
+				if(energy_mode)
+					measure_energy(strat->fn, strategy_arg(strat, dst, wx_pair), &results[test].energy);
+				summarise_samples(&results[test], samples[test], TRIALS);
+				report_result(&results[test]);
+			}
+		}
+	}
+	report_end();
+}
+
+/**************************************/
+// correctness checks
+// run each strategy with verification, plus some stress cases where stale code is more likely to be executed
+
+#ifdef __linux__
+# include <pthread.h>
+# include <sched.h>
+#endif
+
+#ifdef VERIFY
+#define VERIFY_ITERS 10000
+
+static void report_verify(const char* name, uint64_t calls, uint64_t failures) {
+	if(output_format == FORMAT_TEXT) {
+		printf("%20s  %9" PRIu64 " calls  %9" PRIu64 " stale\n", name, calls, failures);
+		return;
+	}
+	row_begin();
+	row_str("strategy", name);
+	row_int("calls", calls);
+	row_int("stale", failures);
+	row_end();
+}
+
+#ifdef __linux__
+// cross-modifying code: one thread writes the code, whilst another executes it
+// the Intel manual requires the executing thread to serialize, which this allows testing without
+typedef struct {
+	void* wmem;
+	void* xmem;
+	int serialize;
+	uint32_t seq, ack; // accessed atomically
+	uint32_t expected;
+	uint64_t failures;
+} xmc_state_t;
+
+static void spin_wait(uint32_t* var, uint32_t value) {
+	unsigned spins = 0;
+	while(__atomic_load_n(var, __ATOMIC_ACQUIRE) != value) {
+		_mm_pause();
+		// don't hog the CPU if both threads are sharing one
+		if(++spins % 1024 == 0) sched_yield();
+	}
+}
+
+static void* xmc_executor(void* arg) {
+	xmc_state_t* state = (xmc_state_t*)arg;
+	for(uint32_t n=1; n<=VERIFY_ITERS; n++) {
+		spin_wait(&state->seq, n);
+		if(state->serialize) {
+			int id[4];
+			_cpuid(id, 1);
+			volatile int unused = id[0];
+			(void)unused;
+		}
+		if(jit_call_zeroed(state->xmem) != state->expected)
+			state->failures++;
+		__atomic_store_n(&state->ack, n, __ATOMIC_RELEASE);
+	}
+	return NULL;
+}
+
+// returns the number of stale executions, or -1 if the thread couldn't be created
+static int64_t run_xmc(void* wmem, void* xmem, int serialize) {
+	xmc_state_t state;
+	memset(&state, 0, sizeof(state));
+	state.wmem = wmem;
+	state.xmem = xmem;
+	state.serialize = serialize;
+	
+	pthread_t thread;
+	if(pthread_create(&thread, NULL, xmc_executor, &state))
+		return -1;
+	for(uint32_t n=1; n<=VERIFY_ITERS; n++) {
+		write_code(state.wmem, 0);
+		state.expected = jit_expected;
+		__atomic_store_n(&state.seq, n, __ATOMIC_RELEASE);
+		spin_wait(&state.ack, n);
+	}
+	pthread_join(thread, NULL);
+	return state.failures;
+}
+#endif
+
+static void run_verify(void** dst, jit_wx_pair* wx_pair) {
+	report_begin("verify");
+	verify_mode = 1;
+	for(unsigned i=0; i<NUM_STRATEGIES; i++) {
+		const strategy_t* strat = strategies + i;
+		void* arg = strategy_arg(strat, dst, wx_pair);
+		verify_calls = verify_failures = 0;
+		for(int n=0; n<VERIFY_ITERS; n++)
+			strat->fn(arg);
+		report_verify(strat->name, verify_calls, verify_failures);
+	}
+	verify_mode = 0;
+	
+#ifdef __linux__
+	struct {
+		const char* name;
+		void* wmem;
+		void* xmem;
+		int serialize;
+	} xmc_tests[] = {
+		{ "xmc_plain", dst[0], dst[0], 0 },
+		{ "xmc_serialize", dst[0], dst[0], 1 },
+		{ "xmc_dual_mapping", wx_pair->wmem, wx_pair->xmem, 0 },
+		{ "xmc_dual_mapping_sync", wx_pair->wmem, wx_pair->xmem, 1 }
+	};
+	for(unsigned i=0; i<sizeof(xmc_tests)/sizeof(xmc_tests[0]); i++) {
+		int64_t failures = run_xmc(xmc_tests[i].wmem, xmc_tests[i].xmem, xmc_tests[i].serialize);
+		if(failures < 0)
+			fprintf(stderr, "Failed to create thread for %s\n", xmc_tests[i].name);
+		else
+			report_verify(xmc_tests[i].name, VERIFY_ITERS, failures);
+	}
+#endif
+	report_end();
+}
+#endif
+
+
+/**************************************/
+// interpreter vs JIT
+// for code which is only run a few times, it may be cheaper to not JIT at all; this compares against interpreting the same program
+
+// the interpreted equivalent of write_code(): a list of (opcode, immediate) pairs
+enum { OP_ADD, OP_RET };
+typedef struct {
+	uint32_t op;
+	uint32_t imm;
+} interp_op_t;
+
+static int bytecode_size = 0; // code size to match
+static void write_bytecode(interp_op_t* code) {
+	static uint32_t base = 0;
+	size_t offset = 0;
+	// same number of instructions as write_code() generates
+	for(int i=0; i<(bytecode_size-2)/5; i++) {
+		code[offset].op = OP_ADD;
+		code[offset].imm = base;
+		offset++;
+		base = base*2 + 1;
+	}
+	code[offset].op = OP_RET;
+}
+
+static int interp_run(const interp_op_t* code) {
+	uint32_t eax = 0;
+#ifdef __GNUC__
+	// threaded dispatch: each handler jumps straight to the next
+	static const void* handlers[] = { &&op_add, &&op_ret };
+	#define DISPATCH goto *handlers[code->op]
+	DISPATCH;
+	op_add:
+		eax += code->imm;
+		code++;
+		DISPATCH;
+	op_ret:
+		return eax;
+	#undef DISPATCH
+#else
+	for(;; code++) {
+		switch(code->op) {
+			case OP_ADD: eax += code->imm; break;
+			case OP_RET: return eax;
+		}
+	}
+#endif
+}
+
+static interp_op_t* bytecode_buf = NULL;
+static void interp_emit(void* dst) {
+	(void)dst;
+	write_bytecode(bytecode_buf);
+	volatile uint32_t unused = bytecode_buf[0].imm;
+	(void)unused;
+}
+static void interp_exec(void* dst) {
+	(void)dst;
+	volatile int unused = interp_run(bytecode_buf);
+	(void)unused;
+}
+// execute already JIT'd code, i.e. the cost of re-running it
+static void jit_exec(void* dst) {
+	jit_call(dst);
+}
+
+static uint64_t time_min(stratfunc_t fn, void* dst, int trials) {
+	uint64_t best = ~0ULL;
+	for(int i=0; i<trials; i++) {
+		uint64_t time = time_jit(fn, dst);
+		if(time < best) best = time;
+	}
+	return best;
+}
+
+// if code is compiled once and run `reuse` times, JIT costs `compile + (reuse-1)*exec`, whilst interpreting costs `emit + reuse*run`
+// returns the smallest reuse count where JIT becomes the cheaper option, or 0 if it never does
+static uint64_t tiering_crossover(double compile, double exec, double emit, double run) {
+	if(compile < emit + run) return 1;
+	if(run <= exec) return 0;
+	return (uint64_t)((compile - exec - emit) / (run - exec)) + 1;
+}
+
+#define SWEEP_TRIALS 3
+static const sized_set_t* tiering_sizes[] = {&sized_set_256, &sized_set_1024, &sized_set_4096, &sized_set_16384, &sized_set_65536};
+static void run_tiering(void** dst) {
+	bytecode_buf = (interp_op_t*)malloc((MAX_CODE_SIZE/5 + 1) * sizeof(interp_op_t));
+	
+	report_begin("tiering");
+	for(unsigned s=0; s<sizeof(tiering_sizes)/sizeof(tiering_sizes[0]); s++) {
+		const sized_set_t* set = tiering_sizes[s];
+		bytecode_size = set->size;
+		
+		// per-call costs, in rdtsc counts
+		double emit = (double)time_min(interp_emit, NULL, SWEEP_TRIALS) / ITERS;
+		double run = (double)time_min(interp_exec, NULL, SWEEP_TRIALS) / ITERS;
+		set->write(dst[0]);
+		double exec = (double)time_min(jit_exec, dst[0], SWEEP_TRIALS) / ITERS;
+		
+		if(output_format == FORMAT_TEXT)
+			printf("%d byte function: interpreter emit %.0f + run %.0f, native run %.0f rdtsc counts\n", set->size, emit, run, exec);
+		for(unsigned i=0; i<NUM_SIZED_STRATEGIES; i++) {
+			const strategy_t* strat = set->strategies + i;
+			double compile = (double)time_min(strat->fn, dst[0], SWEEP_TRIALS) / ITERS;
+			uint64_t crossover = tiering_crossover(compile, exec, emit, run);
+			if(output_format == FORMAT_TEXT) {
+				if(crossover)
+					printf("%26s  %9.0f rdtsc counts/call, JIT wins from %" PRIu64 " runs\n", strat->name, compile, crossover);
+				else
+					printf("%26s  %9.0f rdtsc counts/call, JIT never wins\n", strat->name, compile);
+			} else {
+				char name[64];
+				snprintf(name, sizeof(name), "%s(%d)", strat->name, set->size);
+				row_begin();
+				row_str("name", name);
+				row_int("code_size", set->size);
+				row_str("strategy", strat->name);
+				row_float("compile", compile);
+				row_float("exec", exec);
+				row_float("interp_emit", emit);
+				row_float("interp_run", run);
+				row_int("crossover", crossover);
+				row_end();
+			}
+		}
+	}
+	report_end();
+	
+	free(bytecode_buf);
+}
+
+/**************************************/
+// code cache
+// if the same function gets JIT'd repeatedly, keep it around and skip the JIT (and SMC penalty) altogether
+
+// simple PRNG, so that workloads are reproducible
+static uint32_t rand_state = 1;
+static uint32_t rand_u32() {
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 17;
+	rand_state ^= rand_state << 5;
+	return rand_state;
+}
+
+// what the emitter gets as input; the generated code is entirely determined by this
+typedef struct {
+	uint32_t key;
+	uint32_t size;
+} code_desc_t;
+
+static uint64_t hash_desc(const code_desc_t* desc) {
+	// FNV-1a
+	const uint8_t* p = (const uint8_t*)desc;
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for(size_t i=0; i<sizeof(*desc); i++)
+		hash = (hash ^ p[i]) * 0x100000001b3ULL;
+	return hash;
+}
+
+// same as write_code(), except the immediates are derived from `key`, so the same key always generates the same code
+// returns the sum of the immediates, i.e. what the code should return
+static uint32_t write_code_keyed(void* dst, uint32_t key) {
+	uint8_t* code = (uint8_t*)dst;
+	uint32_t base = key, sum = 0;
+	size_t offset = 0;
+	while(offset<CODE_SIZE-6) {
+		code[offset++] = 5; // ADD eax, imm
+		memcpy(code+offset, &base, 4); // immediate value
+		offset += 4;
+		VERIFY_ONLY(sum += base;)
+		base = base*2 + 1; // "random" transformation
+	}
+	code[offset] = 0xc3; // RET
+	return sum;
+}
+
+#define CACHE_SLOTS 16
+typedef struct {
+	uint64_t hash[CACHE_SLOTS];
+	code_desc_t desc[CACHE_SLOTS]; // hashes can collide, so this is checked before running anything
+	uint32_t expected[CACHE_SLOTS];
+	uint8_t valid[CACHE_SLOTS];
+	uint8_t referenced[CACHE_SLOTS]; // for CLOCK eviction
+	unsigned hand;
+	void** regions;
+	
+	// workload: sequence of functions to run
+	const uint32_t* keys;
+	unsigned num_keys, next_key;
+	uint64_t hits, misses;
+} code_cache_t;
+
+static void cache_reset(code_cache_t* cache) {
+	memset(cache->valid, 0, sizeof(cache->valid));
+	memset(cache->referenced, 0, sizeof(cache->referenced));
+	cache->hand = 0;
+	cache->next_key = 0;
+	cache->hits = cache->misses = 0;
+}
+
+// find the slot holding `desc`, or pick one to replace; returns 1 on a hit
+static int cache_lookup(code_cache_t* cache, const code_desc_t* desc, uint64_t hash, int* slot) {
+	// the cache is small enough that a linear scan is quicker than anything fancier
+	for(int i=0; i<CACHE_SLOTS; i++) {
+		if(cache->valid[i] && cache->hash[i] == hash
+		&& cache->desc[i].key == desc->key && cache->desc[i].size == desc->size) {
+			cache->hits++;
+			cache->referenced[i] = 1;
+			*slot = i;
+			return 1;
+		}
+	}
+	cache->misses++;
+	// CLOCK: skip over recently used slots, clearing their reference bit as we go
+	while(cache->valid[cache->hand] && cache->referenced[cache->hand]) {
+		cache->referenced[cache->hand] = 0;
+		cache->hand = (cache->hand+1) % CACHE_SLOTS;
+	}
+	*slot = cache->hand;
+	cache->hand = (cache->hand+1) % CACHE_SLOTS;
+	cache->hash[*slot] = hash;
+	cache->desc[*slot] = *desc;
+	cache->valid[*slot] = 1;
+	cache->referenced[*slot] = 1;
+	return 0;
+}
+
+static void jit_cached(void* ctx) {
+	code_cache_t* cache = (code_cache_t*)ctx;
+	code_desc_t desc;
+	desc.key = cache->keys[cache->next_key];
+	desc.size = CODE_SIZE;
+	cache->next_key = (cache->next_key+1) % cache->num_keys;
+	
+	int slot;
+	if(!cache_lookup(cache, &desc, hash_desc(&desc), &slot))
+		cache->expected[slot] = write_code_keyed(cache->regions[slot], desc.key);
+	VERIFY_ONLY(jit_expected = cache->expected[slot];)
+	jit_call(cache->regions[slot]);
+}
+
+// generate a workload where `hot_frac` of functions are drawn from a small set of frequently used functions, and the rest are never repeated
+#define CACHE_HOT_KEYS (CACHE_SLOTS/2)
+#define CACHE_WORKLOAD_SEED 1
+static void cache_workload(uint32_t* keys, unsigned num, double hot_frac) {
+	uint32_t unique = CACHE_HOT_KEYS;
+	rand_state = CACHE_WORKLOAD_SEED;
+	for(unsigned i=0; i<num; i++) {
+		if(rand_u32() < hot_frac * 4294967296.0)
+			keys[i] = rand_u32() % CACHE_HOT_KEYS;
+		else
+			keys[i] = unique++;
+	}
+}
+// hit rate of a workload, from replaying it through the cache without generating any code
+static double cache_simulate(const uint32_t* keys, unsigned num) {
+	code_cache_t cache;
+	cache_reset(&cache);
+	code_desc_t desc;
+	desc.size = CODE_SIZE;
+	for(unsigned i=0; i<num; i++) {
+		int slot;
+		desc.key = keys[i];
+		cache_lookup(&cache, &desc, hash_desc(&desc), &slot);
+	}
+	return cache.hits * 100.0 / num;
+}
+// one-off functions push hot ones out of the cache, so the fraction of hot functions doesn't give the hit rate directly; instead, search for the fraction which gives the targeted hit rate
+static void cache_workload_for(uint32_t* keys, unsigned num, unsigned hit_pct) {
+	double lo = 0, hi = 1;
+	for(int i=0; i<20; i++) {
+		double mid = (lo + hi) / 2;
+		cache_workload(keys, num, mid);
+		if(cache_simulate(keys, num) < hit_pct)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	cache_workload(keys, num, hit_pct ? hi : 0);
+}
+
+static const unsigned cache_hit_pcts[] = {0, 25, 50, 75, 90, 99, 100};
+static void run_cache(void** dst, jit_wx_pair* wx_pair) {
+	code_cache_t cache;
+	unsigned num_keys = (PRE_ITERS + ITERS) * TRIALS;
+	uint32_t* keys = (uint32_t*)malloc(num_keys * sizeof(uint32_t));
+	cache.regions = dst;
+	cache.keys = keys;
+	cache.num_keys = num_keys;
+	
+	// reference points: the plain approach, and the best strategy on this machine
+	const strategy_t* best = NULL;
+	uint64_t best_time = ~0ULL, plain_time = 0;
+	for(unsigned i=0; i<NUM_STRATEGIES; i++) {
+		const strategy_t* strat = strategies + i;
+		if(strat->fn == jit_only || strat->unsynced) continue; // not real solutions
+		uint64_t time = time_min(strat->fn, strategy_arg(strat, dst, wx_pair), SWEEP_TRIALS);
+		if(strat->fn == jit_plain) plain_time = time;
+		if(time < best_time) {
+			best_time = time;
+			best = strat;
+		}
+	}
+	
+	report_begin("cache");
+	if(output_format == FORMAT_TEXT) {
+		printf("%20s  %9" PRIu64 " rdtsc counts\n", "jit_plain", plain_time);
+		printf("%20s  %9" PRIu64 " rdtsc counts (best strategy)\n", best->name, best_time);
+	} else {
+		row_begin();
+		row_str("name", "jit_plain");
+		row_str("strategy", "jit_plain");
+		row_null("hit_pct");
+		row_null("measured_hit_pct");
+		row_int("min", plain_time);
+		row_end();
+		row_begin();
+		row_str("name", "best");
+		row_str("strategy", best->name);
+		row_null("hit_pct");
+		row_null("measured_hit_pct");
+		row_int("min", best_time);
+		row_end();
+	}
+	
+	for(unsigned i=0; i<sizeof(cache_hit_pcts)/sizeof(cache_hit_pcts[0]); i++) {
+		char name[32];
+		snprintf(name, sizeof(name), "jit_cached(%u%%)", cache_hit_pcts[i]);
+		cache_workload_for(keys, num_keys, cache_hit_pcts[i]);
+		cache_reset(&cache);
+		uint64_t time = time_min(jit_cached, &cache, TRIALS);
+		double measured = cache.hits * 100.0 / (cache.hits + cache.misses);
+		
+		if(output_format == FORMAT_TEXT)
+			printf("%20s  %9" PRIu64 " rdtsc counts (%.1f%% hits)\n", name, time, measured);
+		else {
+			row_begin();
+			row_str("name", name);
+			row_str("strategy", "jit_cached");
+			row_int("hit_pct", cache_hit_pcts[i]);
+			row_float("measured_hit_pct", measured);
+			row_int("min", time);
+			row_end();
+		}
+	}
+	report_end();
+	
+	free(keys);
+}
+
+/**************************************/
+// background region preparation
+// rather than clearing/flushing regions when they're needed, prepare a pool of regions ahead of time, whilst the CPU would otherwise be idle
+
+#ifdef __linux__
+enum { PREP_NONE, PREP_CLR_1BYTE, PREP_CLFLUSH, PREP_REMAP, NUM_PREP };
+static const char* prep_names[NUM_PREP] = {
+	"none", "clr_1byte", "clflush", "remap"
+};
+// where the preparation is done
+enum { PREP_INLINE, PREP_IDLE_HOOK, PREP_THREAD, NUM_PREP_WHERE };
+static const char* prep_where_names[NUM_PREP_WHERE] = {
+	"inline", "idle_hook", "thread"
+};
+
+static void prep_region(int prep, void** region) {
+	uint8_t* code = (uint8_t*)*region;
+	switch(prep) {
+		case PREP_CLR_1BYTE:
+			for(int i=0; i<CODE_SIZE; i+=64)
+				code[i] = 0;
+		break;
+		case PREP_CLFLUSH:
+			for(int i=0; i<CODE_SIZE; i+=64)
+				_mm_clflush(code + i);
+		break;
+		case PREP_REMAP: {
+			// swap for a fresh page; populate it now so that the fault isn't taken on the request path
+			void* fresh = mmap(NULL, CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANON | MAP_POPULATE, -1, 0);
+			if(fresh != MAP_FAILED) {
+				jit_free(*region, CODE_SIZE);
+				*region = fresh;
+			}
+		} break;
+	}
+}
+
+// single producer, single consumer queue of regions
+#define PREP_SLOTS 32
+typedef struct {
+	void* regions[PREP_SLOTS];
+	uint32_t head, tail; // accessed atomically
+} region_queue_t;
+static void region_queue_push(region_queue_t* queue, void* region) {
+	uint32_t tail = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+	queue->regions[tail % PREP_SLOTS] = region;
+	__atomic_store_n(&queue->tail, tail+1, __ATOMIC_RELEASE);
+}
+static void* region_queue_pop(region_queue_t* queue) {
+	uint32_t head = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+	if(head == __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE))
+		return NULL;
+	void* region = queue->regions[head % PREP_SLOTS];
+	__atomic_store_n(&queue->head, head+1, __ATOMIC_RELEASE);
+	return region;
+}
+
+typedef struct {
+	int prep;
+	region_queue_t ready; // prepared regions, waiting to be used
+	region_queue_t used; // regions waiting to be prepared
+	int stop; // accessed atomically
+} prep_pool_t;
+
+// move one region from the used queue to the ready queue; returns 0 if there was nothing to do
+static int prep_pool_work(prep_pool_t* pool) {
+	void* region = region_queue_pop(&pool->used);
+	if(!region) return 0;
+	prep_region(pool->prep, &region);
+	region_queue_push(&pool->ready, region);
+	return 1;
+}
+static void* prep_thread(void* arg) {
+	prep_pool_t* pool = (prep_pool_t*)arg;
+	// only run when nothing else wants the CPU
+	struct sched_param param;
+	memset(&param, 0, sizeof(param));
+	if(sched_setscheduler(0, SCHED_IDLE, &param) && nice(19) == -1) {
+		// carry on at normal priority; the preparation will just compete more with requests
+	}
+	unsigned spins = 0;
+	while(!__atomic_load_n(&pool->stop, __ATOMIC_ACQUIRE)) {
+		if(prep_pool_work(pool)) continue;
+		_mm_pause();
+		if(++spins % 1024 == 0) sched_yield();
+	}
+	return NULL;
+}
+
+// -ln(x) for 0 < x <= 1, avoiding the need to link libm
+static double neg_ln(double x) {
+	int e = 0;
+	while(x < 1.0) {
+		x *= 2;
+		e++;
+	}
+	double z = (x-1)/(x+1), z2 = z*z;
+	return e*0.69314718055994531 - 2*z*(1 + z2*(1.0/3 + z2*(1.0/5 + z2*(1.0/7 + z2/9))));
+}
+
+typedef struct {
+	double mean;
+	uint64_t p50, p99;
+	double throughput; // requests per million rdtsc counts
+	double utilisation; // % of time this thread spent handling requests or preparing regions
+	unsigned stalls; // requests which found no prepared region available
+} prep_stats_t;
+
+static void prep_pool_free(prep_pool_t* pool) {
+	void* region;
+	while((region = region_queue_pop(&pool->ready)))
+		jit_free(region, CODE_SIZE);
+	while((region = region_queue_pop(&pool->used)))
+		jit_free(region, CODE_SIZE);
+}
+
+// CPU time needed for one request, including preparing its region, wherever that ends up being done
+#define PREP_SERVICE_ITERS 100
+static double prep_service_time(int prep, void** dst) {
+	void* region = dst[0];
+	if(prep != PREP_NONE) {
+		region = jit_alloc(CODE_SIZE);
+		if(region == MAP_FAILED) return 0;
+	}
+	uint64_t best = ~0ULL;
+	for(int trial=0; trial<SWEEP_TRIALS; trial++) {
+		uint64_t start = rdtsc();
+		for(int i=0; i<PREP_SERVICE_ITERS; i++) {
+			if(prep != PREP_NONE) prep_region(prep, &region);
+			write_code(region, 0);
+			jit_call(region);
+		}
+		uint64_t time = rdtsc() - start;
+		if(time < best) best = time;
+	}
+	if(prep != PREP_NONE) jit_free(region, CODE_SIZE);
+	return (double)best / PREP_SERVICE_ITERS;
+}
+
+#define PREP_REQUESTS 2000
+#define PREP_WARMUP 100
+// simulate requests with Poisson arrivals, at a rate which leaves the CPU idle `idle_pct`% of the time if each request takes `service` rdtsc counts
+// returns 0 if the regions or preparation thread couldn't be set up
+static int run_prep_load(int prep, int where, unsigned idle_pct, double service, void** dst, prep_stats_t* stats) {
+	uint64_t arrivals[PREP_REQUESTS + PREP_WARMUP];
+	uint64_t latency[PREP_REQUESTS];
+	double mean_gap = service * 100 / (100 - idle_pct);
+	double t = 0;
+	for(int i=0; i<PREP_REQUESTS + PREP_WARMUP; i++) {
+		t += mean_gap * neg_ln((rand_u32() + 1.0) / 4294967296.0);
+		arrivals[i] = (uint64_t)t;
+	}
+	
+	prep_pool_t pool;
+	memset(&pool, 0, sizeof(pool));
+	pool.prep = prep;
+	// start with all regions prepared
+	for(int i=0; i<PREP_SLOTS; i++) {
+		void* region = jit_alloc(CODE_SIZE);
+		if(region == MAP_FAILED) {
+			prep_pool_free(&pool);
+			return 0;
+		}
+		prep_region(prep, &region);
+		region_queue_push(&pool.ready, region);
+	}
+	pthread_t thread;
+	if(where == PREP_THREAD && pthread_create(&thread, NULL, prep_thread, &pool)) {
+		prep_pool_free(&pool);
+		return 0;
+	}
+	
+	stats->stalls = 0;
+	uint64_t start = rdtsc(), first = 0, busy = 0;
+	for(int i=0; i<PREP_REQUESTS + PREP_WARMUP; i++) {
+		uint64_t arrival = start + arrivals[i];
+		// idle until the request arrives
+		unsigned spins = 0;
+		while(rdtsc() < arrival) {
+			if(where == PREP_IDLE_HOOK) {
+				uint64_t work_start = rdtsc();
+				if(prep_pool_work(&pool)) {
+					if(i >= PREP_WARMUP) busy += rdtsc() - work_start;
+					continue;
+				}
+			}
+			_mm_pause();
+			// give the preparation thread a chance if it shares our CPU
+			if(where == PREP_THREAD && ++spins % 64 == 0) sched_yield();
+		}
+		if(i == PREP_WARMUP) first = arrival;
+		uint64_t begin = rdtsc();
+		
+		void* region;
+		if(prep == PREP_NONE) {
+			region = dst[0];
+		} else if(where == PREP_INLINE) {
+			region = region_queue_pop(&pool.ready);
+			prep_region(prep, &region);
+		} else {
+			region = region_queue_pop(&pool.ready);
+			if(!region) {
+				stats->stalls += i >= PREP_WARMUP;
+				spins = 0;
+				uint64_t wait_start = rdtsc();
+				while(!(region = region_queue_pop(&pool.ready))) {
+					if(where == PREP_IDLE_HOOK)
+						prep_pool_work(&pool); // nothing ready, so have to prepare it ourselves
+					else {
+						// wait for the preparation thread (the used queue only supports one consumer)
+						_mm_pause();
+						if(++spins % 1024 == 0) sched_yield();
+					}
+				}
+				// waiting on the preparation thread isn't work
+				if(where == PREP_THREAD) begin += rdtsc() - wait_start;
+			}
+		}
+		
+		write_code(region, 0);
+		jit_call(region);
+		
+		if(prep != PREP_NONE) {
+			if(where == PREP_INLINE)
+				region_queue_push(&pool.ready, region);
+			else
+				region_queue_push(&pool.used, region);
+		}
+		if(i >= PREP_WARMUP) {
+			uint64_t done = rdtsc();
+			latency[i - PREP_WARMUP] = done - arrival;
+			busy += done - begin;
+		}
+	}
+	uint64_t end = rdtsc();
+	
+	if(where == PREP_THREAD) {
+		__atomic_store_n(&pool.stop, 1, __ATOMIC_RELEASE);
+		pthread_join(thread, NULL);
+	}
+	prep_pool_free(&pool);
+	
+	uint64_t sum = 0;
+	for(int i=0; i<PREP_REQUESTS; i++)
+		sum += latency[i];
+	qsort(latency, PREP_REQUESTS, sizeof(uint64_t), cmp_u64);
+	stats->mean = (double)sum / PREP_REQUESTS;
+	stats->p50 = latency[PREP_REQUESTS/2];
+	stats->p99 = latency[PREP_REQUESTS*99/100];
+	stats->throughput = PREP_REQUESTS * 1000000.0 / (end - first);
+	stats->utilisation = busy * 100.0 / (end - first);
+	return 1;
+}
+
+static const unsigned prep_idle_pcts[] = {10, 30, 50, 70, 90};
+static void run_prep(void** dst) {
+	report_begin("prep");
+	for(int prep=0; prep<NUM_PREP; prep++) {
+		// set the arrival rate from the work each request needs with this preparation, so that the idle % is what's left over
+		double service = prep_service_time(prep, dst);
+		if(service <= 0) {
+			fprintf(stderr, "Failed to allocate region for %s\n", prep_names[prep]);
+			continue;
+		}
+		for(int where=0; where<NUM_PREP_WHERE; where++) {
+			if(prep == PREP_NONE && where != PREP_INLINE) continue;
+			for(unsigned i=0; i<sizeof(prep_idle_pcts)/sizeof(prep_idle_pcts[0]); i++) {
+				prep_stats_t stats;
+				if(!run_prep_load(prep, where, prep_idle_pcts[i], service, dst, &stats)) {
+					fprintf(stderr, "Failed to allocate regions or create preparation thread for %s/%s\n", prep_names[prep], prep_where_names[where]);
+					continue;
+				}
+				if(output_format == FORMAT_TEXT) {
+					char name[40];
+					snprintf(name, sizeof(name), "%s/%s", prep_names[prep], prep_where_names[where]);
+					printf("%20s  idle %2u%% (busy %5.1f%%): latency mean %7.0f p50 %7" PRIu64 " p99 %7" PRIu64 ", %6.1f req/M counts, %u stalls\n",
+						name, prep_idle_pcts[i], stats.utilisation, stats.mean, stats.p50, stats.p99, stats.throughput, stats.stalls);
+				} else {
+					row_begin();
+					row_str("prep", prep_names[prep]);
+					row_str("where", prep_where_names[where]);
+					row_int("idle_pct", prep_idle_pcts[i]);
+					row_float("service", service);
+					row_float("utilisation", stats.utilisation);
+					row_float("mean", stats.mean);
+					row_int("p50", stats.p50);
+					row_int("p99", stats.p99);
+					row_float("throughput", stats.throughput);
+					row_int("stalls", stats.stalls);
+					row_end();
+				}
+			}
+		}
+	}
+	report_end();
+}
+#endif
+
+/**************************************/
+// page swapping
+// write code to a separate page, then swap it into place with mremap, so that nothing mapped as executable is ever written to
+
+#ifdef __linux__
+// threads which do nothing but keep running in this process, so that changes to mappings need TLB shootdowns across CPUs
+static pthread_t sibling_threads[64];
+static int num_siblings = 0;
+static int siblings_stop_flag = 0; // accessed atomically
+static void* sibling_thread(void* arg) {
+	volatile uint8_t* mem = (volatile uint8_t*)arg;
+	while(!__atomic_load_n(&siblings_stop_flag, __ATOMIC_RELAXED)) {
+		// keep a TLB entry live
+		mem[0]++;
+		_mm_pause();
+	}
+	return NULL;
+}
+static uint8_t sibling_mem[64][64];
+static void siblings_start(int n) {
+	if(n > 64) n = 64;
+	__atomic_store_n(&siblings_stop_flag, 0, __ATOMIC_RELAXED);
+	for(num_siblings=0; num_siblings<n; num_siblings++)
+		if(pthread_create(sibling_threads + num_siblings, NULL, sibling_thread, sibling_mem[num_siblings]))
+			break;
+}
+static void siblings_stop() {
+	__atomic_store_n(&siblings_stop_flag, 1, __ATOMIC_RELAXED);
+	for(int i=0; i<num_siblings; i++)
+		pthread_join(sibling_threads[i], NULL);
+	num_siblings = 0;
+}
+static int sibling_count = -1; // set with --threads; default is one per other CPU
+static int get_sibling_count() {
+	if(sibling_count >= 0) return sibling_count;
+	int n = (int)sysconf(_SC_NPROCESSORS_ONLN) - 1;
+	return n < 1 ? 1 : n;
+}
+
+#define PAGE_ROUND(n) (((n) + 4095) & ~(size_t)4095)
+
+typedef struct {
+	void* exec; // where code is executed from
+	void* staging; // where code is written to
+	void* spare; // placeholder address for swapping
+	size_t len;
+	void (*write)(void* dst); // write_code() for the size being tested
+	int fresh;
+	int failed; // set if a mapping operation fails, after which nothing more is done
+} pageswap_t;
+
+static void* map_rw(void* addr, size_t len) {
+	return mmap(addr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON | (addr ? MAP_FIXED : 0), -1, 0);
+}
+static void* map_placeholder(void* addr, size_t len) {
+	return mmap(addr, len, PROT_NONE, MAP_PRIVATE | MAP_ANON | (addr ? MAP_FIXED : 0), -1, 0);
+}
+
+static void pageswap_free(pageswap_t* swap) {
+	if(swap->exec != MAP_FAILED) munmap(swap->exec, swap->len);
+	if(swap->staging != MAP_FAILED) munmap(swap->staging, swap->len);
+	if(swap->spare != MAP_FAILED) munmap(swap->spare, swap->len);
+}
+static void pageswap_init(pageswap_t* swap, const sized_set_t* set, int fresh) {
+	swap->len = PAGE_ROUND(set->size);
+	swap->write = set->write;
+	swap->fresh = fresh;
+	swap->exec = mmap(NULL, swap->len, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANON, -1, 0);
+	swap->staging = map_rw(NULL, swap->len);
+	swap->spare = map_placeholder(NULL, swap->len);
+	swap->failed = swap->exec == MAP_FAILED || swap->staging == MAP_FAILED || swap->spare == MAP_FAILED;
+	if(swap->failed) {
+		pageswap_free(swap);
+		swap->exec = swap->staging = swap->spare = MAP_FAILED;
+	}
+}
+
+// recycle pages: swap the executable and staging pages; returns 0 if any mapping operation fails
+static int pageswap_swap(pageswap_t* swap) {
+	if(mprotect(swap->staging, swap->len, PROT_READ | PROT_EXEC)) return 0;
+	// move the old code out of the way, then move the new code in
+	void* old = mremap(swap->exec, swap->len, swap->len, MREMAP_MAYMOVE | MREMAP_FIXED, swap->spare);
+	if(old == MAP_FAILED) return 0;
+	swap->spare = old; // the placeholder was replaced, so this is what needs unmapping if anything fails from here
+	void* vacated = swap->staging;
+	if(mremap(vacated, swap->len, swap->len, MREMAP_MAYMOVE | MREMAP_FIXED, swap->exec) == MAP_FAILED) return 0;
+	swap->staging = old;
+	// stop anything else claiming the address just vacated
+	swap->spare = map_placeholder(vacated, swap->len);
+	if(swap->spare == MAP_FAILED) return 0;
+	return !mprotect(old, swap->len, PROT_READ | PROT_WRITE);
+}
+static void jit_pageswap(void* ctx) {
+	pageswap_t* swap = (pageswap_t*)ctx;
+	if(swap->failed) return;
+	swap->write(swap->staging);
+	if(!pageswap_swap(swap)) {
+		swap->failed = 1;
+		return;
+	}
+	jit_call(swap->exec);
+}
+// as above, but use fresh pages for staging each time; the old code is discarded by mremap
+static int pageswap_swap_fresh(pageswap_t* swap) {
+	if(mprotect(swap->staging, swap->len, PROT_READ | PROT_EXEC)) return 0;
+	if(mremap(swap->staging, swap->len, swap->len, MREMAP_MAYMOVE | MREMAP_FIXED, swap->exec) == MAP_FAILED) return 0;
+	swap->staging = map_rw(NULL, swap->len);
+	return swap->staging != MAP_FAILED;
+}
+static void jit_pageswap_fresh(void* ctx) {
+	pageswap_t* swap = (pageswap_t*)ctx;
+	if(swap->failed) return;
+	swap->write(swap->staging);
+	if(!pageswap_swap_fresh(swap)) {
+		swap->failed = 1;
+		return;
+	}
+	jit_call(swap->exec);
+}
+
+// alternate the executable address between two buffers in a memfd, which are written via a separate (never executable) mapping
+typedef struct {
+	int fd;
+	uint8_t* wmem; // both buffers
+	void* exec;
+	size_t len;
+	void (*write)(void* dst);
+	int cur;
+	int failed;
+} memfd_swap_t;
+static void memfd_swap_free(memfd_swap_t* swap) {
+	if(swap->wmem != MAP_FAILED) munmap(swap->wmem, swap->len*2);
+	if(swap->exec != MAP_FAILED) munmap(swap->exec, swap->len);
+	if(swap->fd >= 0) close(swap->fd);
+}
+static void memfd_swap_init(memfd_swap_t* swap, const sized_set_t* set) {
+	swap->len = PAGE_ROUND(set->size);
+	swap->write = set->write;
+	swap->cur = 0;
+	swap->wmem = (uint8_t*)MAP_FAILED;
+	swap->exec = MAP_FAILED;
+	swap->fd = memfd_create("jit_memfd_swap", 0);
+	if(swap->fd >= 0 && !ftruncate(swap->fd, swap->len*2)) {
+		swap->wmem = (uint8_t*)mmap(NULL, swap->len*2, PROT_READ | PROT_WRITE, MAP_SHARED, swap->fd, 0);
+		swap->exec = mmap(NULL, swap->len, PROT_READ | PROT_EXEC, MAP_SHARED, swap->fd, 0);
+	}
+	swap->failed = swap->wmem == MAP_FAILED || swap->exec == MAP_FAILED;
+	if(swap->failed) {
+		memfd_swap_free(swap);
+		swap->fd = -1;
+		swap->wmem = (uint8_t*)MAP_FAILED;
+		swap->exec = MAP_FAILED;
+	}
+}
+static void jit_memfd_swap(void* ctx) {
+	memfd_swap_t* swap = (memfd_swap_t*)ctx;
+	if(swap->failed) return;
+	swap->cur ^= 1;
+	swap->write(swap->wmem + swap->cur*swap->len);
+	if(mmap(swap->exec, swap->len, PROT_READ | PROT_EXEC, MAP_SHARED | MAP_FIXED, swap->fd, swap->cur*swap->len) == MAP_FAILED) {
+		// the old mapping may be gone, so nothing's left to unmap
+		swap->exec = MAP_FAILED;
+		swap->failed = 1;
+		return;
+	}
+	jit_call(swap->exec);
+}
+
+static const sized_set_t* pageswap_sizes[] = {&sized_set_1024, &sized_set_4096, &sized_set_16384, &sized_set_65536};
+static void run_pageswap(void** dst) {
+	int threads[2] = {0, get_sibling_count()};
+	
+	report_begin("pageswap");
+	for(int t=0; t<2; t++) {
+		siblings_start(threads[t]);
+		for(unsigned s=0; s<sizeof(pageswap_sizes)/sizeof(pageswap_sizes[0]); s++) {
+			const sized_set_t* set = pageswap_sizes[s];
+			pageswap_t swap, swap_fresh;
+			memfd_swap_t mswap;
+			pageswap_init(&swap, set, 0);
+			pageswap_init(&swap_fresh, set, 1);
+			memfd_swap_init(&mswap, set);
+			struct {
+				const char* name;
+				stratfunc_t fn;
+				void* arg;
+				const int* failed; // for the page swapping strategies
+			} tests[] = {
+				{ "jit_plain", sized_strategy(set, "jit_plain"), dst[0], NULL },
+				{ "jit_memcpy_sse2_nt", sized_strategy(set, "jit_memcpy_sse2_nt"), dst[0], NULL },
+				{ "jit_memcpy_sse2_nt_sfence", sized_strategy(set, "jit_memcpy_sse2_nt_sfence"), dst[0], NULL },
+				{ "jit_pageswap", jit_pageswap, &swap, &swap.failed },
+				{ "jit_pageswap_fresh", jit_pageswap_fresh, &swap_fresh, &swap_fresh.failed },
+				{ "jit_memfd_swap", jit_memfd_swap, &mswap, &mswap.failed }
+			};
+			for(unsigned i=0; i<sizeof(tests)/sizeof(tests[0]); i++) {
+				uint64_t time = time_min(tests[i].fn, tests[i].arg, SWEEP_TRIALS);
+				if(tests[i].failed && *tests[i].failed) {
+					fprintf(stderr, "%s: mapping operation failed, skipping %d byte test\n", tests[i].name, set->size);
+					continue;
+				}
+				if(output_format == FORMAT_TEXT)
+					printf("%5d bytes, %2d threads: %26s  %9" PRIu64 " rdtsc counts\n", set->size, num_siblings, tests[i].name, time);
+				else {
+					char name[64];
+					snprintf(name, sizeof(name), "%s(%d,%d)", tests[i].name, set->size, num_siblings);
+					row_begin();
+					row_str("name", name);
+					row_int("code_size", set->size);
+					row_int("threads", num_siblings);
+					row_str("strategy", tests[i].name);
+					row_int("min", time);
+					row_end();
+				}
+			}
+			pageswap_free(&swap);
+			pageswap_free(&swap_fresh);
+			memfd_swap_free(&mswap);
+		}
+		siblings_stop();
+	}
+	report_end();
+}
+#endif
+
+/**************************************/
+// allocation lifecycle
+// jit_realloc shows the cost of getting fresh pages for each JIT; break that cost down, and try some ways of recycling pages
+
+#ifdef __linux__
+enum {
+	LIFE_REALLOC, // mmap + munmap each time, like jit_realloc
+	LIFE_POPULATE, // as above, with MAP_POPULATE
+	LIFE_POOL, // take pages from a pool, populated in batches, unmapped individually
+	LIFE_DONTNEED, // reuse a page, dropping it with MADV_DONTNEED after use
+	LIFE_FREE, // reuse a page, dropping it with MADV_FREE after use
+	LIFE_LAZY_UNMAP, // take pages from an arena, only unmapping once the whole arena is used
+	NUM_LIFE
+};
+static const char* life_names[NUM_LIFE] = {
+	"realloc", "populate", "pool_populate", "madv_dontneed", "madv_free", "lazy_unmap"
+};
+enum { PHASE_ALLOC, PHASE_TOUCH, PHASE_WRITE, PHASE_EXEC, PHASE_FREE, NUM_PHASES };
+static const char* phase_names[NUM_PHASES] = {
+	"alloc", "touch", "write", "exec", "free"
+};
+
+#define LIFE_BATCH 64 // pages per pool/arena
+
+typedef struct {
+	int variant;
+	size_t len;
+	uint8_t* batch; // current pool/arena
+	int batch_used;
+	uint8_t* region; // for reused pages
+	uint64_t phases[NUM_PHASES];
+	int failed; // set if mapping fails, after which nothing more is done
+} lifecycle_t;
+
+static void* map_rwx(size_t len, int flags) {
+	void* mem = mmap(NULL, len, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANON | flags, -1, 0);
+	return mem == MAP_FAILED ? NULL : mem;
+}
+
+static void jit_lifecycle(void* ctx) {
+	lifecycle_t* life = (lifecycle_t*)ctx;
+	uint8_t* code = NULL;
+	uint64_t t[NUM_PHASES+1];
+	if(life->failed) return;
+	
+	t[0] = rdtsc();
+	switch(life->variant) {
+		case LIFE_REALLOC:
+			code = (uint8_t*)map_rwx(life->len, 0);
+		break;
+		case LIFE_POPULATE:
+			code = (uint8_t*)map_rwx(life->len, MAP_POPULATE);
+		break;
+		case LIFE_POOL:
+		case LIFE_LAZY_UNMAP:
+			if(!life->batch || life->batch_used == LIFE_BATCH) {
+				life->batch = (uint8_t*)map_rwx(life->len * LIFE_BATCH, life->variant == LIFE_POOL ? MAP_POPULATE : 0);
+				life->batch_used = 0;
+				if(!life->batch) break;
+			}
+			code = life->batch + life->len * life->batch_used++;
+		break;
+		default:
+			code = life->region;
+	}
+	t[1] = rdtsc();
+	if(!code) {
+		life->failed = 1;
+		return;
+	}
+	// first write to each page, which takes the page fault if there is one
+	for(size_t i=0; i<life->len; i+=4096)
+		code[i] = 0xc3;
+	t[2] = rdtsc();
+	write_code(code, 0);
+	t[3] = rdtsc();
+	jit_call(code);
+	t[4] = rdtsc();
+	switch(life->variant) {
+		case LIFE_REALLOC:
+		case LIFE_POPULATE:
+		case LIFE_POOL:
+			munmap(code, life->len);
+		break;
+		case LIFE_DONTNEED:
+			madvise(code, life->len, MADV_DONTNEED);
+		break;
+		case LIFE_FREE:
+#ifdef MADV_FREE
+			madvise(code, life->len, MADV_FREE);
+#endif
+		break;
+		case LIFE_LAZY_UNMAP:
+			// the arena is only unmapped once all of it has been used
+			if(life->batch_used == LIFE_BATCH) {
+				munmap(life->batch, life->len * LIFE_BATCH);
+				life->batch = NULL;
+			}
+		break;
+	}
+	t[5] = rdtsc();
+	
+	for(int i=0; i<NUM_PHASES; i++)
+		life->phases[i] += t[i+1] - t[i];
+}
+
+static void lifecycle_init(lifecycle_t* life, int variant) {
+	memset(life, 0, sizeof(*life));
+	life->variant = variant;
+	life->len = PAGE_ROUND(CODE_SIZE);
+	if(variant == LIFE_DONTNEED || variant == LIFE_FREE) {
+		life->region = (uint8_t*)map_rwx(life->len, 0);
+		life->failed = !life->region;
+	}
+}
+static void lifecycle_free(lifecycle_t* life) {
+	if(life->region)
+		munmap(life->region, life->len);
+	if(life->batch && life->variant == LIFE_LAZY_UNMAP)
+		munmap(life->batch, life->len * LIFE_BATCH);
+	else if(life->batch) // unused pages left in pool
+		munmap(life->batch + life->len * life->batch_used, life->len * (LIFE_BATCH - life->batch_used));
+}
+
+static void run_lifecycle() {
+	int threads[2] = {0, get_sibling_count()};
+	
+	report_begin("lifecycle");
+	if(output_format == FORMAT_TEXT)
+		printf("%26s  %9s  %9s %9s %9s %9s %9s  (rdtsc counts per JIT call)\n", "", "total", "alloc", "touch", "write", "exec", "free");
+	for(int t=0; t<2; t++) {
+		siblings_start(threads[t]);
+		for(int variant=0; variant<NUM_LIFE; variant++) {
+#ifndef MADV_FREE
+			if(variant == LIFE_FREE) continue;
+#endif
+			// take the fastest trial, but keep its breakdown
+			uint64_t best = ~0ULL;
+			uint64_t phases[NUM_PHASES];
+			int failed = 0;
+			for(int trial=0; trial<SWEEP_TRIALS && !failed; trial++) {
+				lifecycle_t life;
+				lifecycle_init(&life, variant);
+				for(int i=0; i<PRE_ITERS; i++)
+					jit_lifecycle(&life);
+				memset(life.phases, 0, sizeof(life.phases));
+				for(int i=0; i<ITERS; i++)
+					jit_lifecycle(&life);
+				lifecycle_free(&life);
+				failed = life.failed;
+				
+				uint64_t total = 0;
+				for(int p=0; p<NUM_PHASES; p++)
+					total += life.phases[p];
+				if(total < best) {
+					best = total;
+					memcpy(phases, life.phases, sizeof(phases));
+				}
+			}
+			if(failed) {
+				fprintf(stderr, "%s: failed to map pages, skipping\n", life_names[variant]);
+				continue;
+			}
+			
+			if(output_format == FORMAT_TEXT) {
+				char name[40];
+				snprintf(name, sizeof(name), "%s, %d threads", life_names[variant], num_siblings);
+				printf("%26s  %9" PRIu64 " ", name, best / ITERS);
+				for(int p=0; p<NUM_PHASES; p++)
+					printf(" %9" PRIu64, phases[p] / ITERS);
+				printf("\n");
+			} else {
+				row_begin();
+				row_str("variant", life_names[variant]);
+				row_int("threads", num_siblings);
+				row_int("total", best / ITERS);
+				for(int p=0; p<NUM_PHASES; p++)
+					row_int(phase_names[p], phases[p] / ITERS);
+				row_end();
+			}
+		}
+		siblings_stop();
+	}
+	report_end();
+}
+#endif
+
+/**************************************/
+// fused emit + mitigate, vs separate passes
+
+static const int fused_distances[] = {0, 1, 2, 4, 8, 16};
+static void run_fused(void** dst) {
+	#define MAX_FUSED_TESTS 16
+	struct {
+		char name[40];
+		stratfunc_t fn;
+		int distance;
+	} tests[MAX_FUSED_TESTS];
+	int num = 0;
+	#define ADD_FUSED_TEST(f, d, label) \
+		tests[num].fn = f; \
+		tests[num].distance = d; \
+		snprintf(tests[num].name, sizeof(tests[num].name), "%s", label); \
+		num++
+	
+	ADD_FUSED_TEST(jit_plain, 0, "jit_plain");
+	ADD_FUSED_TEST(jit_only, 0, "jit_only");
+	// separate passes
+	ADD_FUSED_TEST(jit_clr_1byte, 0, "jit_clr_1byte");
+#ifdef __CLFLUSHOPT__
+	ADD_FUSED_TEST(jit_clflushopt_after, 0, "jit_clflushopt_after");
+#endif
+#ifdef __CLDEMOTE__
+	ADD_FUSED_TEST(jit_cldemote_after, 0, "jit_cldemote_after");
+#endif
+	ADD_FUSED_TEST(jit_memcpy_sse2_nt, 0, "jit_memcpy_sse2_nt");
+	// fused
+	for(unsigned i=0; i<sizeof(fused_distances)/sizeof(fused_distances[0]); i++) {
+		ADD_FUSED_TEST(jit_fused_clr_ahead, fused_distances[i], "");
+		snprintf(tests[num-1].name, sizeof(tests[num-1].name), "jit_fused_clr_ahead(%d)", fused_distances[i]);
+	}
+#ifdef __CLFLUSHOPT__
+	ADD_FUSED_TEST(jit_fused_clflushopt, 0, "jit_fused_clflushopt");
+#endif
+#ifdef __CLDEMOTE__
+	ADD_FUSED_TEST(jit_fused_cldemote, 0, "jit_fused_cldemote");
+#endif
+	ADD_FUSED_TEST(jit_fused_nt, 0, "jit_fused_nt");
+	#undef ADD_FUSED_TEST
+	
+	int saved_distance = fused_distance;
+	uint64_t samples[MAX_FUSED_TESTS][TRIALS];
+	test_result_t results[MAX_FUSED_TESTS];
+	memset(results, 0, sizeof(results));
+	for(int trial=0; trial<TRIALS; trial++) {
+		for(int i=0; i<num; i++) {
+			fused_distance = tests[i].distance;
+			uint64_t time = time_jit(tests[i].fn, dst[0]);
+			samples[i][trial] = time;
+			if(!trial || time < results[i].min) {
+				results[i].min = time;
+				memcpy(results[i].counters, counter_values, sizeof(counter_values));
+			}
+		}
+	}
+	fused_distance = saved_distance;
+	
+	if(output_format == FORMAT_TEXT)
+		printf("staging buffer: jit_memcpy_sse2_nt %d bytes, jit_fused_nt %d bytes\n", CODE_SIZE, FUSED_NT_STAGING);
+	report_begin("fused");
+	for(int i=0; i<num; i++) {
+		results[i].name = tests[i].name;
+		summarise_samples(results + i, samples[i], TRIALS);
+		report_result(results + i);
+	}
+	report_end();
+}
+
+/**************************************/
+// topology placement
+// SMC handling may affect other code running on the same core (e.g. the other hyperthread), so run something alongside the JIT, placed at varying distances from it
+
+#ifdef __linux__
+# include <dirent.h>
+# define MAX_CPUS 1024
+typedef struct {
+	int online;
+	int package, die, core, node;
+} cpu_topology_t;
+static cpu_topology_t cpu_topology[MAX_CPUS];
+static int num_cpus = 0;
+
+static int read_int_file(const char* path, int* value) {
+	FILE* f = fopen(path, "r");
+	if(!f) return 0;
+	int ok = fscanf(f, "%d", value) == 1;
+	fclose(f);
+	return ok;
+}
+static void read_topology() {
+	char path[128];
+	num_cpus = (int)sysconf(_SC_NPROCESSORS_CONF);
+	if(num_cpus > MAX_CPUS) num_cpus = MAX_CPUS;
+	for(int cpu=0; cpu<num_cpus; cpu++) {
+		cpu_topology_t* t = cpu_topology + cpu;
+		int online = 1;
+		// cpu0 usually has no 'online' file, as it can't be taken offline
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/online", cpu);
+		read_int_file(path, &online);
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/core_id", cpu);
+		t->online = online && read_int_file(path, &t->core);
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+		if(!read_int_file(path, &t->package)) t->package = 0;
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/die_id", cpu);
+		if(!read_int_file(path, &t->die)) t->die = 0;
+		// NUMA node is given by a nodeN link in the CPU's directory
+		t->node = 0;
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+		DIR* dir = opendir(path);
+		if(dir) {
+			struct dirent* ent;
+			while((ent = readdir(dir)))
+				if(!strncmp(ent->d_name, "node", 4) && ent->d_name[4] >= '0' && ent->d_name[4] <= '9') {
+					t->node = atoi(ent->d_name + 4);
+					break;
+				}
+			closedir(dir);
+		}
+	}
+}
+
+enum { PLACE_SIBLING, PLACE_CORE, PLACE_REMOTE, NUM_PLACES };
+static const char* place_names[NUM_PLACES] = {
+	"sibling", // other hyperthread on the same core
+	"core", // different core, same package
+	"remote" // different package or NUMA node
+};
+// find a CPU at the given distance from `cpu`, or -1 if there isn't one
+static int find_cpu(int cpu, int place) {
+	const cpu_topology_t* a = cpu_topology + cpu;
+	for(int i=0; i<num_cpus; i++) {
+		const cpu_topology_t* b = cpu_topology + i;
+		if(i == cpu || !b->online) continue;
+		int same_package = a->package == b->package && a->die == b->die;
+		int same_core = same_package && a->core == b->core;
+		if(place == PLACE_SIBLING && same_core) return i;
+		if(place == PLACE_CORE && same_package && !same_core && a->node == b->node) return i;
+		if(place == PLACE_REMOTE && (!same_package || a->node != b->node)) return i;
+	}
+	return -1;
+}
+
+static int pin_thread(pthread_t thread, int cpu) {
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return !pthread_setaffinity_np(thread, sizeof(set), &set);
+}
+
+// the 'victim': hot code running alongside the JIT
+enum { VICTIM_ALU, VICTIM_ICACHE, NUM_VICTIMS };
+static const char* victim_names[NUM_VICTIMS] = {"alu", "icache"};
+static int victim_kind = VICTIM_ALU;
+static int jit_cpu = 0;
+typedef struct {
+	int kind;
+	int stop; // accessed atomically
+	uint64_t iterations; // accessed atomically
+} victim_t;
+static void* victim_thread(void* arg) {
+	victim_t* victim = (victim_t*)arg;
+	uint32_t x = 1;
+	while(!__atomic_load_n(&victim->stop, __ATOMIC_RELAXED)) {
+		if(victim->kind == VICTIM_ICACHE)
+			jmp32k(); // touches all of L1i
+		else {
+			for(int i=0; i<1000; i++) {
+				x = x*3 + 1;
+				__asm__ __volatile__("" : "+r"(x));
+			}
+		}
+		__atomic_store_n(&victim->iterations, victim->iterations + 1, __ATOMIC_RELAXED);
+	}
+	return NULL;
+}
+static int victim_start(victim_t* victim, pthread_t* thread, int cpu) {
+	memset(victim, 0, sizeof(*victim));
+	victim->kind = victim_kind;
+	if(pthread_create(thread, NULL, victim_thread, victim))
+		return 0;
+	if(!pin_thread(*thread, cpu)) {
+		__atomic_store_n(&victim->stop, 1, __ATOMIC_RELAXED);
+		pthread_join(*thread, NULL);
+		return 0;
+	}
+	return 1;
+}
+static void victim_stop(victim_t* victim, pthread_t thread) {
+	__atomic_store_n(&victim->stop, 1, __ATOMIC_RELAXED);
+	pthread_join(thread, NULL);
+}
+// victim iterations per million rdtsc counts
+static double victim_rate(victim_t* victim, uint64_t* last_iters, uint64_t* last_time) {
+	uint64_t iters = __atomic_load_n(&victim->iterations, __ATOMIC_RELAXED);
+	uint64_t time = rdtsc();
+	double rate = (iters - *last_iters) * 1e6 / (time - *last_time);
+	*last_iters = iters;
+	*last_time = time;
+	return rate;
+}
+
+static void run_smt(void** dst, jit_wx_pair* wx_pair) {
+	read_topology();
+	if(jit_cpu >= num_cpus || !cpu_topology[jit_cpu].online) {
+		fprintf(stderr, "CPU %d not available\n", jit_cpu);
+		return;
+	}
+	cpu_set_t saved;
+	if(pthread_getaffinity_np(pthread_self(), sizeof(saved), &saved)) {
+		fprintf(stderr, "Failed to get CPU affinity\n");
+		return;
+	}
+	if(!pin_thread(pthread_self(), jit_cpu)) {
+		fprintf(stderr, "Failed to pin JIT thread to CPU %d\n", jit_cpu);
+		return;
+	}
+	
+	report_begin("smt");
+	
+	// JIT on its own
+	uint64_t alone[NUM_STRATEGIES];
+	for(unsigned i=0; i<NUM_STRATEGIES; i++)
+		alone[i] = time_min(strategies[i].fn, strategy_arg(strategies + i, dst, wx_pair), SWEEP_TRIALS);
+	
+	for(int place=-1; place<NUM_PLACES; place++) {
+		int cpu = -1;
+		victim_t victim;
+		pthread_t thread;
+		double victim_alone = 0;
+		if(place >= 0) {
+			cpu = find_cpu(jit_cpu, place);
+			if(cpu < 0 || !victim_start(&victim, &thread, cpu)) {
+				if(output_format == FORMAT_TEXT)
+					printf("%s: no CPU available\n", place_names[place]);
+				continue;
+			}
+			// measure the victim whilst the JIT thread sleeps
+			uint64_t last_iters = 0, last_time = rdtsc();
+			usleep(100000);
+			victim_alone = victim_rate(&victim, &last_iters, &last_time);
+			if(output_format == FORMAT_TEXT)
+				printf("%s: JIT on CPU %d, %s victim on CPU %d (%.1f iterations/M counts on its own)\n",
+					place_names[place], jit_cpu, victim_names[victim_kind], cpu, victim_alone);
+		} else if(output_format == FORMAT_TEXT)
+			printf("alone: JIT on CPU %d\n", jit_cpu);
+		
+		for(unsigned i=0; i<NUM_STRATEGIES; i++) {
+			const strategy_t* strat = strategies + i;
+			uint64_t time = alone[i];
+			double rate = 0, relative = 0;
+			if(place >= 0) {
+				uint64_t last_iters = __atomic_load_n(&victim.iterations, __ATOMIC_RELAXED), last_time = rdtsc();
+				time = time_min(strat->fn, strategy_arg(strat, dst, wx_pair), SWEEP_TRIALS);
+				rate = victim_rate(&victim, &last_iters, &last_time);
+				relative = victim_alone > 0 ? rate * 100 / victim_alone : 0;
+			}
+			const char* place_name = place >= 0 ? place_names[place] : "alone";
+			if(output_format == FORMAT_TEXT) {
+				printf("%20s  %9" PRIu64 " rdtsc counts (%5.1f%% of alone)", strat->name, time, alone[i] * 100.0 / time);
+				if(place >= 0)
+					printf(", victim at %5.1f%%", relative);
+				printf("\n");
+			} else {
+				char name[64];
+				snprintf(name, sizeof(name), "%s/%s", place_name, strat->name);
+				row_begin();
+				row_str("name", name);
+				row_str("placement", place_name);
+				row_int("jit_cpu", jit_cpu);
+				row_str("strategy", strat->name);
+				row_int("min", time);
+				if(place >= 0) {
+					row_int("victim_cpu", cpu);
+					row_str("victim", victim_names[victim_kind]);
+					row_float("victim_rate", rate);
+					row_float("victim_relative", relative);
+				} else {
+					row_null("victim_cpu");
+					row_null("victim");
+					row_null("victim_rate");
+					row_null("victim_relative");
+				}
+				row_end();
+			}
+		}
+		if(place >= 0)
+			victim_stop(&victim, thread);
+	}
+	report_end();
+	
+	pthread_setaffinity_np(pthread_self(), sizeof(saved), &saved);
+}
+#endif
+
+static void usage(const char* prog) {
+	fprintf(stderr, "Usage: %s [--format=text|json|csv] [--energy] [--threads=n] [--combo|--tiering|--verify|--cache|--prep|--pageswap|--lifecycle|--fused|--smt]\n", prog);
+	fprintf(stderr, "  --energy   also measure energy usage of each strategy via RAPL (normal test only)\n");
+	fprintf(stderr, "  --combo    search combinations of mitigation stages\n");
+	fprintf(stderr, "  --tiering  find where JIT becomes cheaper than interpreting\n");
+	fprintf(stderr, "  --verify   check that strategies never execute stale code (compile with -DVERIFY)\n");
+	fprintf(stderr, "  --cache    cache JIT'd functions, across varying hit ratios\n");
+	fprintf(stderr, "  --fused    compare mitigations fused into the JIT against separate passes\n");
+#ifdef __linux__
+	fprintf(stderr, "  --prep     prepare regions in the background, under a simulated load\n");
+	fprintf(stderr, "  --pageswap swap written pages into place with mremap\n");
+	fprintf(stderr, "  --lifecycle break down the cost of allocating fresh pages, and ways of recycling them\n");
+	fprintf(stderr, "  --threads  number of other threads to run, for TLB shootdowns (default: one per other CPU)\n");
+	fprintf(stderr, "  --smt      run a victim thread on the sibling hyperthread/another core/another socket\n");
+	fprintf(stderr, "  --victim   victim for --smt: alu (default) or icache\n");
+	fprintf(stderr, "  --cpu      CPU to run the JIT on for --smt (default 0)\n");
+#endif
+}
+
+enum { MODE_STRATEGIES, MODE_COMBO, MODE_TIERING, MODE_VERIFY, MODE_CACHE, MODE_FUSED, MODE_PREP, MODE_PAGESWAP, MODE_LIFECYCLE, MODE_SMT };
+
+int main(int argc, char** argv) {
+	int mode = MODE_STRATEGIES;
+	for(int i=1; i<argc; i++) {
+		if(!strcmp(argv[i], "--combo"))
+			mode = MODE_COMBO;
+		else if(!strcmp(argv[i], "--tiering"))
+			mode = MODE_TIERING;
+		else if(!strcmp(argv[i], "--verify")) {
+#ifdef VERIFY
+			mode = MODE_VERIFY;
+#else
+			fprintf(stderr, "--verify needs the test to be compiled with -DVERIFY\n");
+			return 1;
+#endif
+		}
+		else if(!strcmp(argv[i], "--cache"))
+			mode = MODE_CACHE;
+		else if(!strcmp(argv[i], "--fused"))
+			mode = MODE_FUSED;
+#ifdef __linux__
+		else if(!strcmp(argv[i], "--prep"))
+			mode = MODE_PREP;
+		else if(!strcmp(argv[i], "--pageswap"))
+			mode = MODE_PAGESWAP;
+		else if(!strcmp(argv[i], "--lifecycle"))
+			mode = MODE_LIFECYCLE;
+		else if(!strncmp(argv[i], "--threads=", 10))
+			sibling_count = atoi(argv[i] + 10);
+		else if(!strcmp(argv[i], "--smt"))
+			mode = MODE_SMT;
+		else if(!strcmp(argv[i], "--victim=alu"))
+			victim_kind = VICTIM_ALU;
+		else if(!strcmp(argv[i], "--victim=icache"))
+			victim_kind = VICTIM_ICACHE;
+		else if(!strncmp(argv[i], "--cpu=", 6)) {
+			jit_cpu = atoi(argv[i] + 6);
+			if(jit_cpu < 0) {
+				fprintf(stderr, "CPU number can't be negative\n");
+				return 1;
+			}
+		}
+#endif
+		else if(!strcmp(argv[i], "--energy"))
+			energy_mode = 1;
+		else if(!strcmp(argv[i], "--format=text"))
+			output_format = FORMAT_TEXT;
+		else if(!strcmp(argv[i], "--format=json"))
+			output_format = FORMAT_JSON;
+		else if(!strcmp(argv[i], "--format=csv"))
+			output_format = FORMAT_CSV;
+		else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	
+	if(energy_mode && mode != MODE_STRATEGIES) {
+		fprintf(stderr, "--energy is only supported for the normal test\n");
+		return 1;
+	}
+	
+	get_cpu_sig(&cpu_sig);
+	// counters only add noise to the plain text output, which is intended for reading
+	if(output_format != FORMAT_TEXT)
+		counters_init(&cpu_sig);
+	if(energy_mode && !rapl_init(&cpu_sig)) {
+		fprintf(stderr, "RAPL energy counters not available; energy will not be measured\n");
+		energy_mode = 0;
+	}
+	
+	// sweeps need space for the largest function size they test
+	size_t region_size = CODE_SIZE;
+	if(mode == MODE_TIERING)
+		region_size = MAX_CODE_SIZE;
+#ifdef __linux__
+	if(mode == MODE_PAGESWAP)
+		region_size = MAX_CODE_SIZE;
+#endif
+	void* dst[NUM_REGIONS];
+	for(int i=0; i<NUM_REGIONS; i++) {
+		void* region = jit_alloc(region_size);
+		if(!region) {
+			printf("Failed to allocate write+execute page\n");
+			return 1;
+		}
+		if((uintptr_t)region & 63) {
+			printf("Allocated page isn't cacheline aligned?!\n");
+			return 1;
+		}
+		dst[i] = region;
+	}
+	
+	
+	jit_wx_pair wx_pair = {0};
+	jit_alloc_wx_alias(region_size, &wx_pair.wmem, &wx_pair.xmem);
+	if(!wx_pair.wmem) {
+		printf("Failed to allocate shared page\n");
+		return 1;
+	}
+	
+	jit_only_init();
+	
+	if(mode == MODE_COMBO)
+		run_combo_search(dst);
+	else if(mode == MODE_TIERING)
+		run_tiering(dst);
+#ifdef VERIFY
+	else if(mode == MODE_VERIFY)
+		run_verify(dst, &wx_pair);
+#endif
+	else if(mode == MODE_CACHE)
+		run_cache(dst, &wx_pair);
+	else if(mode == MODE_FUSED)
+		run_fused(dst);
+#ifdef __linux__
+	else if(mode == MODE_PREP)
+		run_prep(dst);
+	else if(mode == MODE_PAGESWAP)
+		run_pageswap(dst);
+	else if(mode == MODE_LIFECYCLE)
+		run_lifecycle();
+	else if(mode == MODE_SMT)
+		run_smt(dst, &wx_pair);
+#endif
+	else
+		run_strategies(dst, &wx_pair);
 	
 	for(int i=0; i<NUM_REGIONS; i++)
-		jit_free(dst[i], CODE_SIZE);
+		jit_free(dst[i], region_size);
 	
-	jit_free_wx_alias(CODE_SIZE, wx_pair.wmem, wx_pair.xmem);
+	jit_free_wx_alias(region_size, wx_pair.wmem, wx_pair.xmem);
 	
 	return 0;
 }